@@ -0,0 +1,435 @@
+#include "BinaryReaders.hpp"
+#include "LineChunks.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+///> more columns than that can't be a Native block header
+constexpr uint64_t g_max_native_columns{1 << 16};
+
+bool decodeString(std::string_view& value, const char*& begin,
+                  const char* end) {
+    uint64_t size{0};
+    if (!decodeVarint(size, begin, end) ||
+            size > static_cast<uint64_t>(end - begin)) {
+        return false;
+    }
+    value = std::string_view(begin, size);
+    begin += size;
+    return true;
+}
+
+std::runtime_error truncated(std::string_view format) {
+    return std::runtime_error("truncated " + std::string(format) + " input");
+}
+
+std::invalid_argument unskippable(std::string_view type) {
+    return std::invalid_argument("can't skip a Native column of type " +
+                                 std::string(type));
+}
+
+///> "Name(a, b)" as "Name" and its arguments, "Name" alone as "Name"
+std::pair<std::string_view, std::vector<std::string_view>>
+splitType(std::string_view type) {
+    size_t open = type.find('(');
+    if (open == std::string_view::npos) {
+        return {type, {}};
+    }
+    if (type.back() != ')') {
+        throw unskippable(type);
+    }
+    std::vector<std::string_view> arguments;
+    size_t depth{0}, from{open + 1};
+    bool quoted{false};
+    for (size_t i = from; i + 1 < type.size(); ++i) {
+        char c = type[i];
+        if (quoted) {
+            if (c == '\\') {
+                ++i;
+            } else if (c == '\'') {
+                quoted = false;
+            }
+        } else if (c == '\'') {
+            quoted = true;
+        } else if (c == '(') {
+            ++depth;
+        } else if (c == ')') {
+            --depth;
+        } else if (c == ',' && !depth) {
+            arguments.push_back(type.substr(from, i - from));
+            from = i + 1;
+        }
+    }
+    arguments.push_back(type.substr(from, type.size() - 1 - from));
+    for (auto& argument: arguments) {
+        size_t first = argument.find_first_not_of(' ');
+        argument.remove_prefix(std::min(first, argument.size()));
+        argument.remove_suffix(argument.size() -
+                               (argument.find_last_not_of(' ') + 1));
+    }
+    return {type.substr(0, open), arguments};
+}
+
+///> bytes of a value of a fixed width type, 0 for other types
+size_t fixedWidth(std::string_view name,
+                  const std::vector<std::string_view>& arguments) {
+    static const std::pair<std::string_view, size_t> widths[]{
+        {"UInt8", 1}, {"Int8", 1}, {"Bool", 1}, {"Enum8", 1}, {"Nothing", 1},
+        {"UInt16", 2}, {"Int16", 2}, {"Date", 2}, {"Enum16", 2},
+        {"UInt32", 4}, {"Int32", 4}, {"Float32", 4}, {"Date32", 4},
+        {"DateTime", 4}, {"IPv4", 4}, {"Decimal32", 4},
+        {"UInt64", 8}, {"Int64", 8}, {"Float64", 8}, {"DateTime64", 8},
+        {"Decimal64", 8},
+        {"UInt128", 16}, {"Int128", 16}, {"UUID", 16}, {"IPv6", 16},
+        {"Decimal128", 16},
+        {"UInt256", 32}, {"Int256", 32}, {"Decimal256", 32},
+    };
+    for (const auto& [type, width]: widths) {
+        if (type == name) {
+            return width;
+        }
+    }
+    size_t parameter{0};
+    if ((name == "FixedString" || name == "Decimal") && !arguments.empty()) {
+        std::from_chars(arguments[0].data(),
+                        arguments[0].data() + arguments[0].size(), parameter);
+    }
+    if (name == "FixedString") {
+        return parameter;
+    }
+    if (name == "Decimal") {
+        return parameter <= 9 ? 4 : parameter <= 18 ? 8 :
+            parameter <= 38 ? 16 : 32;
+    }
+    return 0;
+}
+
+template <typename T>
+T decodeFixed(const char*& begin, const char* end) {
+    T value;
+    if (static_cast<size_t>(end - begin) < sizeof(value)) {
+        throw truncated("Native");
+    }
+    std::memcpy(&value, begin, sizeof(value));
+    begin += sizeof(value);
+    return value;
+}
+
+void skipBytes(uint64_t bytes, const char*& begin, const char* end) {
+    if (bytes > static_cast<uint64_t>(end - begin)) {
+        throw truncated("Native");
+    }
+    begin += bytes;
+}
+
+///> skips the state a column writes before its values, e.g. the key
+///> version of LowCardinality
+void skipPrefix(std::string_view type, const char*& begin, const char* end) {
+    auto [name, arguments] = splitType(type);
+    if (name == "LowCardinality") {
+        decodeFixed<uint64_t>(begin, end);
+    } else if (name == "Array" || name == "Nullable" || name == "Tuple" ||
+               name == "Map") {
+        for (auto argument: arguments) {
+            skipPrefix(argument, begin, end);
+        }
+    }
+}
+
+/*!
+ * @brief skips the values of a column of type the reader doesn't map
+ * @throw std::invalid_argument if the layout of the type isn't known
+ * @details Array and Map values are their offsets then the nested
+ *  values, Nullable ones a null map then the values, Tuple ones every
+ *  element's values; LowCardinality ones granules of a dictionary and
+ *  indexes into it
+ */
+void skipValues(std::string_view type, uint64_t rows, const char*& begin,
+                const char* end) {
+    auto [name, arguments] = splitType(type);
+    if (size_t width = fixedWidth(name, arguments)) {
+        if (rows > static_cast<uint64_t>(end - begin) / width) {
+            throw truncated("Native");
+        }
+        begin += rows * width;
+    } else if (name == "String") {
+        for (uint64_t i = 0; i < rows; ++i) {
+            uint64_t size{0};
+            if (!decodeVarint(size, begin, end)) {
+                throw truncated("Native");
+            }
+            skipBytes(size, begin, end);
+        }
+    } else if (name == "Nullable" && arguments.size() == 1) {
+        skipBytes(rows, begin, end);
+        skipValues(arguments[0], rows, begin, end);
+    } else if ((name == "Array" && arguments.size() == 1) ||
+               (name == "Map" && arguments.size() == 2)) {
+        if (rows > static_cast<uint64_t>(end - begin) / sizeof(uint64_t)) {
+            throw truncated("Native");
+        }
+        uint64_t nested{0};
+        if (rows) {
+            std::memcpy(&nested, begin + (rows - 1) * sizeof(nested),
+                        sizeof(nested));
+        }
+        begin += rows * sizeof(uint64_t);
+        for (auto argument: arguments) {
+            skipValues(argument, nested, begin, end);
+        }
+    } else if (name == "Tuple" && !arguments.empty()) {
+        for (auto argument: arguments) {
+            // a named element is "name Type"
+            size_t space = argument.find(' ');
+            if (space != std::string_view::npos &&
+                    space < argument.find('(')) {
+                argument.remove_prefix(space + 1);
+            }
+            skipValues(argument, rows, begin, end);
+        }
+    } else if (name == "LowCardinality" && arguments.size() == 1) {
+        constexpr uint64_t index_width_mask{0xff};
+        constexpr uint64_t has_additional_keys{1 << 9};
+        auto [inner, inner_arguments] = splitType(arguments[0]);
+        std::string_view dictionary = inner == "Nullable" &&
+            inner_arguments.size() == 1 ? inner_arguments[0] : arguments[0];
+        for (uint64_t read = 0; read < rows;) {
+            auto index_type = decodeFixed<uint64_t>(begin, end);
+            if ((index_type & index_width_mask) > 3) {
+                throw unskippable(type);
+            }
+            if (index_type & has_additional_keys) {
+                skipValues(dictionary, decodeFixed<uint64_t>(begin, end),
+                           begin, end);
+            }
+            auto indexes = decodeFixed<uint64_t>(begin, end);
+            if (!indexes) {
+                throw unskippable(type);
+            }
+            size_t width = size_t{1} << (index_type & index_width_mask);
+            if (indexes > static_cast<uint64_t>(end - begin) / width) {
+                throw truncated("Native");
+            }
+            begin += indexes * width;
+            read += indexes;
+        }
+    } else {
+        throw unskippable(type);
+    }
+}
+
+/*!
+ * @brief moves the keys failing validator to the rejects
+ * @details the n-th row is numbered as line n
+ */
+void rejectKeys(rows_t& rows, const std::optional<ColumnValidator>& validator) {
+    rows.lines = rows.size();
+    if (!validator) {
+        return;
+    }
+    std::vector<size_t> rejected;
+    for (size_t row = 0; row < rows.size(); ++row) {
+        if (const char* reason = validator->Check(rows.keys[row])) {
+            rows.rejects.push_back({row + 1, std::string(rows.keys[row]),
+                                    reason});
+            rejected.push_back(row);
+        }
+    }
+    rows.Erase(rejected);
+}
+
+/*!
+ * @return whether the key is a UInt64 one
+ * @throw std::invalid_argument if the reader has no columns or the key
+ *  is neither a String nor a UInt64
+ */
+bool checkKey(const NativeReader::scheme_t& columns) {
+    if (columns.empty()) {
+        throw std::invalid_argument("binary input needs table columns");
+    }
+    if (columns[0].second != "String" && columns[0].second != "UInt64") {
+        throw std::invalid_argument("key column " + columns[0].first +
+                                    " is neither a String nor a UInt64");
+    }
+    return columns[0].second == "UInt64";
+}
+
+/*!
+ * @brief appends rows keys: String ones to rows.keys, UInt64 ones to
+ *  rows.integer_keys and, as text, to rows.keys
+ * @return false if the input ends first
+ */
+bool decodeKeys(rows_t& rows, bool integer, size_t keys, const char*& begin,
+                const char* end) {
+    if (!integer) {
+        return decodeBinary(rows.keys, keys, begin, end);
+    }
+    if (keys > static_cast<size_t>(end - begin) / sizeof(uint64_t)) {
+        return false;
+    }
+    for (size_t i = 0; i < keys; ++i) {
+        uint64_t key;
+        std::memcpy(&key, begin, sizeof(key));
+        begin += sizeof(key);
+        rows.integer_keys.push_back(key);
+        char text[20];
+        auto text_end = std::to_chars(text, text + sizeof(text), key).ptr;
+        rows.keys.push_back({text, static_cast<size_t>(text_end - text)});
+    }
+    return true;
+}
+}
+
+NativeReader::NativeReader(const scheme_t& columns,
+                           std::optional<ColumnValidator> validator):
+    columns_{columns}, validator_{std::move(validator)}
+{}
+
+/*!
+ * @brief reads the whole stream and parses it
+ */
+rows_t NativeReader::Read(std::istream& input) const {
+    return Parse(readAll(input));
+}
+
+/*!
+ * @throw std::runtime_error if data is truncated
+ * @throw std::invalid_argument if a block lacks the key or a column of
+ *  the first block, or a column's type isn't the table's one, or a
+ *  column the table hasn't is of a type whose layout isn't known
+ */
+rows_t NativeReader::Parse(std::string_view data) const {
+    bool integer = checkKey(columns_);
+    rows_t rows;
+    const char* begin = data.data();
+    const char* end = begin + data.size();
+    for (bool first = true; begin != end; first = false) {
+        uint64_t block_columns{0}, block_rows{0};
+        if (!decodeVarint(block_columns, begin, end) ||
+                !decodeVarint(block_rows, begin, end)) {
+            throw truncated("Native");
+        }
+        if (!block_columns) {
+            continue;
+        }
+        size_t filled{0};
+        bool has_key{false};
+        for (uint64_t i = 0; i < block_columns; ++i) {
+            std::string_view name, type;
+            if (!decodeString(name, begin, end) ||
+                    !decodeString(type, begin, end)) {
+                throw truncated("Native");
+            }
+            size_t column{0};
+            while (column < columns_.size() && columns_[column].first != name) {
+                ++column;
+            }
+            if (column < columns_.size() && columns_[column].second != type) {
+                throw std::invalid_argument(
+                    "column " + std::string(name) + " is " +
+                    std::string(type) + " instead of " +
+                    columns_[column].second);
+            }
+            column_data_t* values{nullptr};
+            if (column == columns_.size()) {
+                skipPrefix(type, begin, end);
+                skipValues(type, block_rows, begin, end);
+                continue;
+            } else if (column) {
+                auto found = std::find_if(rows.columns.begin(),
+                                          rows.columns.end(),
+                    [name] (const column_t& c) { return c.name == name; });
+                if (found == rows.columns.end()) {
+                    if (!first) {
+                        throw std::invalid_argument(
+                            "column " + std::string(name) +
+                            " isn't in the first block");
+                    }
+                    rows.columns.push_back({std::string(name),
+                                            makeColumnData(type)});
+                    found = rows.columns.end() - 1;
+                }
+                values = &found->data;
+                ++filled;
+            } else {
+                has_key = true;
+            }
+            bool complete = values ?
+                decodeBinary(*values, block_rows, begin, end) :
+                decodeKeys(rows, integer, block_rows, begin, end);
+            if (!complete) {
+                throw truncated("Native");
+            }
+        }
+        if (!has_key || filled != rows.columns.size()) {
+            throw std::invalid_argument(
+                "a Native block lacks the key or a column");
+        }
+    }
+    rejectKeys(rows, validator_);
+    return rows;
+}
+
+/*!
+ * @details the first column's header has to be sane and of a type
+ *  makeColumnData knows
+ */
+bool NativeReader::Sniff(std::string_view data) {
+    const char* begin = data.data();
+    const char* end = begin + data.size();
+    uint64_t block_columns{0}, block_rows{0};
+    std::string_view name, type;
+    if (!decodeVarint(block_columns, begin, end) ||
+            !block_columns || block_columns > g_max_native_columns ||
+            !decodeVarint(block_rows, begin, end) ||
+            !decodeString(name, begin, end) || name.empty() ||
+            !decodeString(type, begin, end)) {
+        return false;
+    }
+    try {
+        makeColumnData(type);
+    } catch (const std::invalid_argument&) {
+        return false;
+    }
+    return true;
+}
+
+RowBinaryReader::RowBinaryReader(const scheme_t& columns,
+                                 std::optional<ColumnValidator> validator):
+    columns_{columns}, validator_{std::move(validator)}
+{}
+
+/*!
+ * @brief reads the whole stream and parses it
+ */
+rows_t RowBinaryReader::Read(std::istream& input) const {
+    return Parse(readAll(input));
+}
+
+/*!
+ * @throw std::runtime_error if data ends within a row
+ */
+rows_t RowBinaryReader::Parse(std::string_view data) const {
+    bool integer = checkKey(columns_);
+    rows_t rows;
+    for (size_t i = 1; i < columns_.size(); ++i) {
+        rows.columns.push_back({columns_[i].first,
+                                makeColumnData(columns_[i].second)});
+    }
+    const char* begin = data.data();
+    const char* end = begin + data.size();
+    while (begin != end) {
+        bool complete = decodeKeys(rows, integer, 1, begin, end);
+        for (auto& column: rows.columns) {
+            complete = complete && decodeBinary(column.data, 1, begin, end);
+        }
+        if (!complete) {
+            throw truncated("RowBinary");
+        }
+    }
+    rejectKeys(rows, validator_);
+    return rows;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ColumnValidator.hpp"
+#include "Columns.hpp"
+
+/*!
+ * @brief reads a ClickHouse Native dump: blocks of named and typed
+ *  columns, each stored as one run of values
+ * @details columns are mapped by name, the ones which aren't columns
+ *  of the reader (e.g. id) are skipped by the layout of their type,
+ *  Nullable, Array, Map, Tuple and LowCardinality ones included. Number
+ *  columns are copied with a memcpy per block, so they have to be of
+ *  the table's type. The key is a String or a UInt64, kept as a number
+ *  and as text.
+ */
+class NativeReader final {
+public:
+    typedef std::vector<std::pair<std::string, std::string>> scheme_t;
+
+    /*!
+     * @param columns name and type of the key column, then the other
+     *  columns a file may fill
+     * @param validator check of the keys, the rows failing it become
+     *  rejects numbered by row
+     */
+    explicit NativeReader(const scheme_t& columns,
+                          std::optional<ColumnValidator> validator = {});
+
+    rows_t Read(std::istream& input) const;
+    rows_t Parse(std::string_view data) const;
+    ///> whether data starts with a Native block header of a known type
+    static bool Sniff(std::string_view data);
+private:
+    scheme_t columns_;
+    std::optional<ColumnValidator> validator_;
+};
+
+/*!
+ * @brief reads a ClickHouse RowBinary dump: rows of the reader's
+ *  columns in their order, one value after another
+ */
+class RowBinaryReader final {
+public:
+    typedef NativeReader::scheme_t scheme_t;
+
+    ///> see NativeReader
+    explicit RowBinaryReader(const scheme_t& columns,
+                             std::optional<ColumnValidator> validator = {});
+
+    rows_t Read(std::istream& input) const;
+    rows_t Parse(std::string_view data) const;
+private:
+    scheme_t columns_;
+    std::optional<ColumnValidator> validator_;
+};
@@ -0,0 +1,228 @@
+#include "BlockSink.hpp"
+#include "Columns.hpp"
+
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+
+#include <lz4.h>
+#include <zlib.h>
+#include <zstd.h>
+
+namespace ch = clickhouse;
+
+namespace {
+constexpr int g_zstd_level{1};
+constexpr size_t g_write_chunk{1 << 20};
+constexpr std::time_t g_seconds_per_day{24 * 60 * 60};
+
+void appendString(std::string_view value, std::string& to) {
+    encodeVarint(value.size(), to);
+    to.append(value);
+}
+
+template <typename T>
+bool appendNumbers(const ch::ColumnRef& column, std::string& to) {
+    auto values = column->As<ch::ColumnVector<T>>();
+    if (!values) {
+        return false;
+    }
+    size_t at = to.size();
+    to.resize(at + values->Size() * sizeof(T));
+    for (size_t i = 0; i < values->Size(); ++i) {
+        std::memcpy(to.data() + at + i * sizeof(T), &values->At(i),
+                    sizeof(T));
+    }
+    return true;
+}
+
+template <typename... T>
+bool appendAnyNumbers(const ch::ColumnRef& column, std::string& to) {
+    return (appendNumbers<T>(column, to) || ...);
+}
+}
+
+void serializeNative(const ch::Block& block, std::string& to) {
+    encodeVarint(block.GetColumnCount(), to);
+    encodeVarint(block.GetRowCount(), to);
+    for (size_t i = 0; i < block.GetColumnCount(); ++i) {
+        const auto& column = block[i];
+        appendString(block.GetColumnName(i), to);
+        std::string type = column->Type()->GetName();
+        appendString(type, to);
+        if (auto strings = column->As<ch::ColumnString>()) {
+            for (size_t row = 0; row < strings->Size(); ++row) {
+                appendString(strings->At(row), to);
+            }
+        } else if (auto dates = column->As<ch::ColumnDate>()) {
+            for (size_t row = 0; row < dates->Size(); ++row) {
+                auto days = static_cast<uint16_t>(dates->At(row) /
+                                                   g_seconds_per_day);
+                to.append(reinterpret_cast<const char*>(&days), sizeof(days));
+            }
+        } else if (auto times = column->As<ch::ColumnDateTime>()) {
+            for (size_t row = 0; row < times->Size(); ++row) {
+                auto seconds = static_cast<uint32_t>(times->At(row));
+                to.append(reinterpret_cast<const char*>(&seconds),
+                          sizeof(seconds));
+            }
+        } else if (!appendAnyNumbers<uint8_t, uint16_t, uint32_t, uint64_t,
+                                     int8_t, int16_t, int32_t, int64_t,
+                                     float, double>(column, to)) {
+            throw std::invalid_argument("can't write a column of type " +
+                                        type);
+        }
+    }
+}
+
+ClientSink::ClientSink(ch::Client& client): client_(&client)
+{}
+
+void ClientSink::Insert(const std::string& table, const ch::Block& block) {
+    client_->Insert(table, block);
+}
+
+struct NativeFileSink::encoder_t {
+    compression_t compression;
+    z_stream gzip{};
+    ZSTD_CStream* zstd{nullptr};
+
+    ~encoder_t() {
+        if (compression == compression_t::gzip) {
+            deflateEnd(&gzip);
+        } else {
+            ZSTD_freeCStream(zstd);
+        }
+    }
+};
+
+/*!
+ * @throw std::runtime_error if the file can't be created
+ * @throw std::invalid_argument for lz4
+ */
+NativeFileSink::NativeFileSink(const std::string& path,
+                               compression_t compression):
+    path_{path}, file_{path, std::ios::binary | std::ios::trunc}
+{
+    if (!file_) {
+        throw std::runtime_error("can't create file " + path);
+    }
+    switch (compression) {
+    case compression_t::none:
+        return;
+    case compression_t::lz4:
+        throw std::invalid_argument("lz4 files can't be written");
+    case compression_t::gzip:
+        encoder_.reset(new encoder_t{compression});
+        // 16 + window bits makes a gzip header and trailer
+        if (deflateInit2(&encoder_->gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("can't init gzip");
+        }
+        return;
+    case compression_t::zstd:
+        encoder_.reset(new encoder_t{compression});
+        encoder_->zstd = ZSTD_createCStream();
+        if (!encoder_->zstd || ZSTD_isError(ZSTD_initCStream(
+                encoder_->zstd, g_zstd_level))) {
+            throw std::runtime_error("can't init zstd");
+        }
+        return;
+    }
+}
+
+/*!
+ * @details errors are reported to std::cerr, a destructor can't throw
+ */
+NativeFileSink::~NativeFileSink() {
+    try {
+        Write({}, true);
+    } catch (const std::exception& e) {
+        std::cerr << "can't finish " << path_ << ": " << e.what()
+                  << std::endl;
+    }
+}
+
+/*!
+ * @throw std::runtime_error if the file can't be written
+ */
+void NativeFileSink::Insert(const std::string&, const ch::Block& block) {
+    buffer_.clear();
+    serializeNative(block, buffer_);
+    Write(buffer_, false);
+}
+
+/*!
+ * @brief compresses data if needed and writes it
+ * @param last completes the compressed stream
+ */
+void NativeFileSink::Write(std::string_view data, bool last) {
+    std::string& chunk = compressed_;
+    chunk.resize(g_write_chunk);
+    if (!encoder_) {
+        file_.write(data.data(), data.size());
+    } else if (encoder_->compression == compression_t::gzip) {
+        auto& gzip = encoder_->gzip;
+        gzip.next_in = reinterpret_cast<Bytef*>(
+            const_cast<char*>(data.data()));
+        gzip.avail_in = static_cast<uInt>(data.size());
+        int res{Z_OK};
+        do {
+            gzip.next_out = reinterpret_cast<Bytef*>(chunk.data());
+            gzip.avail_out = static_cast<uInt>(chunk.size());
+            res = deflate(&gzip, last ? Z_FINISH : Z_NO_FLUSH);
+            if (res == Z_STREAM_ERROR) {
+                throw std::runtime_error("gzip failed for " + path_);
+            }
+            file_.write(chunk.data(), chunk.size() - gzip.avail_out);
+        } while (gzip.avail_out == 0 || (last && res != Z_STREAM_END));
+    } else {
+        ZSTD_inBuffer in{data.data(), data.size(), 0};
+        size_t remaining{0};
+        do {
+            ZSTD_outBuffer out{chunk.data(), chunk.size(), 0};
+            remaining = ZSTD_compressStream2(encoder_->zstd, &out, &in,
+                last ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining)) {
+                throw std::runtime_error("zstd failed for " + path_);
+            }
+            file_.write(chunk.data(), out.pos);
+        } while (last ? remaining != 0 : in.pos != in.size);
+    }
+    if (last) {
+        file_.flush();
+    }
+    if (!file_) {
+        throw std::runtime_error("can't write file " + path_);
+    }
+}
+
+/*!
+ * @throw std::invalid_argument for gzip, it isn't a wire compression
+ */
+DryRunSink::DryRunSink(compression_t compression): compression_{compression}
+{
+    if (compression == compression_t::gzip) {
+        throw std::invalid_argument("gzip isn't a wire compression");
+    }
+}
+
+void DryRunSink::Insert(const std::string&, const ch::Block& block) {
+    buffer_.clear();
+    serializeNative(block, buffer_);
+    switch (compression_) {
+    case compression_t::lz4:
+        compressed_.resize(LZ4_compressBound(buffer_.size()));
+        LZ4_compress_default(buffer_.data(), compressed_.data(),
+                             buffer_.size(), compressed_.size());
+        break;
+    case compression_t::zstd:
+        compressed_.resize(ZSTD_compressBound(buffer_.size()));
+        ZSTD_compress(compressed_.data(), compressed_.size(),
+                      buffer_.data(), buffer_.size(), g_zstd_level);
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <fstream>
+#include <memory>
+#include <string>
+#include <clickhouse/client.h>
+
+#include "InputFile.hpp"
+
+/*!
+ * @brief where the filler's blocks go
+ */
+class BlockSink {
+public:
+    virtual ~BlockSink() = default;
+
+    ///> table is "db.table"
+    virtual void Insert(const std::string& table,
+                        const clickhouse::Block& block) = 0;
+};
+
+/*!
+ * @brief inserts blocks into a table of a server
+ */
+class ClientSink final : public BlockSink {
+public:
+    explicit ClientSink(clickhouse::Client& client);
+
+    void Insert(const std::string& table,
+                const clickhouse::Block& block) override;
+private:
+    clickhouse::Client* client_;
+};
+
+/*!
+ * @brief appends blocks to a file in the Native format, e.g. for
+ *  clickhouse-client --query "INSERT INTO db.table FORMAT Native"
+ * @details the blocks of all tables go to the same file; a compressed
+ *  file is one gzip or zstd stream completed by the destructor
+ */
+class NativeFileSink final : public BlockSink {
+public:
+    ///> lz4 isn't supported for writing
+    NativeFileSink(const std::string& path, compression_t compression);
+    ~NativeFileSink() override;
+
+    void Insert(const std::string& table,
+                const clickhouse::Block& block) override;
+private:
+    struct encoder_t;
+
+    void Write(std::string_view data, bool last);
+
+    std::string path_;
+    std::ofstream file_;
+    std::unique_ptr<encoder_t> encoder_;    ///> none if not compressed
+    std::string buffer_;
+    std::string compressed_;
+};
+
+/*!
+ * @brief does to blocks what the client does before sending them:
+ *  serializes them and compresses them block by block, then drops them
+ * @details for measuring the whole load but the network
+ */
+class DryRunSink final : public BlockSink {
+public:
+    ///> lz4 or zstd as on the wire, or none
+    explicit DryRunSink(compression_t compression);
+
+    void Insert(const std::string& table,
+                const clickhouse::Block& block) override;
+private:
+    compression_t compression_;
+    std::string buffer_;
+    std::string compressed_;
+};
+
+/*!
+ * @brief appends block in the Native format
+ * @throw std::invalid_argument for a column of a type rows_t hasn't
+ */
+void serializeNative(const clickhouse::Block& block, std::string& to);
@@ -0,0 +1,83 @@
+#include "Checkpoint.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/*!
+ * @return checkpoint stored in path or nullopt if there is none
+ * @throw std::runtime_error if the file is corrupted
+ */
+std::optional<Checkpoint> Checkpoint::Load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return std::nullopt;
+    }
+    Checkpoint checkpoint;
+    std::string pending;
+    if (!(file >> checkpoint.inode >> checkpoint.offset
+               >> checkpoint.pushed >> checkpoint.duplicated >> pending)) {
+        throw std::runtime_error("corrupted checkpoint " + path);
+    }
+    if (pending == "pending") {
+        block_t block;
+        size_t size{0};
+        if (!(file >> block.begin >> block.end >> block.rows
+                   >> block.first_id >> size) || file.get() != ' ') {
+            throw std::runtime_error("corrupted checkpoint " + path);
+        }
+        block.first_value.resize(size);
+        if (!file.read(block.first_value.data(), size) ||
+                file.get() != '\n') {
+            throw std::runtime_error("corrupted checkpoint " + path);
+        }
+        checkpoint.pending = std::move(block);
+    }
+    return checkpoint;
+}
+
+/*!
+ * @brief replaces the checkpoint stored in path
+ * @throw std::runtime_error if it can't be written
+ * @details the first value is stored after its size, as it may hold
+ *  newlines; the checkpoint is written and fsynced aside, then renamed
+ *  over the old one, so a crash leaves one of them whole
+ */
+void Checkpoint::Save(const std::string& path) const {
+    std::ostringstream text;
+    text << inode << ' ' << offset << ' '
+         << pushed << ' ' << duplicated << ' ';
+    if (pending) {
+        text << "pending " << pending->begin << ' ' << pending->end << ' '
+             << pending->rows << ' ' << pending->first_id << ' '
+             << pending->first_value.size() << ' '
+             << pending->first_value << '\n';
+    } else {
+        text << "committed\n";
+    }
+    std::string stored{text.str()};
+    std::string tmp{path + ".tmp"};
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (fd < 0) {
+        throw std::runtime_error("can't write checkpoint " + tmp);
+    }
+    bool written{true};
+    for (size_t at = 0; written && at < stored.size();) {
+        ssize_t bytes = ::write(fd, stored.data() + at, stored.size() - at);
+        written = bytes > 0;
+        at += written ? bytes : 0;
+    }
+    written = ::fsync(fd) == 0 && written;
+    written = ::close(fd) == 0 && written;
+    if (!written) {
+        throw std::runtime_error("can't write checkpoint " + tmp);
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("can't replace checkpoint " + path);
+    }
+}
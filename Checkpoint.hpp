@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/*!
+ * @brief progress of a resumable load of one file
+ * @details saved before and after every block insert: a pending block
+ *  is one which may or may not have reached the table
+ */
+struct Checkpoint {
+    struct block_t {
+        uint64_t begin;             ///> offset of the block's first line
+        uint64_t end;               ///> offset after its last line
+        size_t rows;
+        uint64_t first_id;          ///> id and value of its first row,
+        std::string first_value;    ///< enough to probe for the block
+    };
+
+    uint64_t inode{0};      ///> of the loaded file
+    uint64_t offset{0};     ///> everything before it is committed
+    size_t pushed{0};
+    size_t duplicated{0};
+    std::optional<block_t> pending;
+
+    static std::optional<Checkpoint> Load(const std::string& path);
+    void Save(const std::string& path) const;
+};
@@ -5,12 +5,147 @@
  * Created on 19 января 2021 г., 16:29
  */
 #include "ClickhouseFiller.hpp"
-#include "nlohmann_json/json.hpp"
+#include "InputFile.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <deque>
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
+#include <tuple>
 
 #include <fmt/format.h>
 #include <fmt/compile.h>
 
 namespace ch = clickhouse;
+
+namespace {
+constexpr ClickhouseFiller::block_limits_t g_default_block_limits{
+    1 << 20, 256 << 20, false, std::chrono::milliseconds(1000)
+};
+constexpr size_t g_min_adaptive_block_rows{1024};
+constexpr size_t g_initial_adaptive_block_rows{64 * 1024};
+constexpr size_t g_max_block_retries{8};
+constexpr std::chrono::milliseconds g_follow_wait{1000};
+///> bytes a file's format is sniffed from
+constexpr size_t g_sniff_bytes{64 * 1024};
+///> server error codes meaning it can't keep up with inserts
+constexpr int g_too_many_simultaneous_queries{202};
+constexpr int g_too_many_parts{252};
+
+///> peak resident set size of the process in bytes
+size_t peakRss() {
+    struct rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+///> a column of a composite key: the keys of rows or another column
+struct key_part_t {
+    const StringPool* keys;
+    const std::vector<uint64_t>* integer_keys;
+    const column_data_t* data;
+};
+
+///> how keys are taken from the rows and the table, by their set
+template <typename Set>
+struct key_traits;
+
+template <>
+struct key_traits<FlatSet<uint64_t>> {
+    typedef uint64_t key_t;
+    ///> @throw std::runtime_error if key isn't a decimal UInt64
+    static key_t Parse(std::string_view key) {
+        key_t number{0};
+        auto [end, error] = std::from_chars(key.data(),
+                                            key.data() + key.size(), number);
+        if (error != std::errc{} || end != key.data() + key.size()) {
+            throw std::runtime_error("key " + std::string(key) +
+                                     " isn't a UInt64");
+        }
+        return number;
+    }
+    static key_t Key(const rows_t& rows, size_t row,
+                     const std::vector<key_part_t>&, std::string&) {
+        return rows.integer_keys[row];
+    }
+    static key_t At(const ch::ColumnRef& column, size_t row) {
+        return column->As<ch::ColumnUInt64>()->At(row);
+    }
+};
+
+/*!
+ * @brief writes the values of row in parts to tuple as RowBinary does
+ * @details the encoding is the same for the values read from files and
+ *  the ones selected, UInt64 keys are written as numbers
+ */
+void encodeKey(const std::vector<key_part_t>& parts, size_t row,
+               std::string& tuple) {
+    tuple.clear();
+    for (const key_part_t& part: parts) {
+        if (part.data) {
+            encodeBinary(*part.data, row, tuple);
+        } else if (part.integer_keys) {
+            uint64_t key = (*part.integer_keys)[row];
+            tuple.append(reinterpret_cast<const char*>(&key), sizeof(key));
+        } else {
+            std::string_view key = (*part.keys)[row];
+            encodeVarint(key.size(), tuple);
+            tuple.append(key);
+        }
+    }
+}
+
+template <>
+struct key_traits<KeySet> {
+    typedef std::string_view key_t;
+    static key_t Parse(std::string_view key) {
+        return key;
+    }
+    ///> the key of row or, with parts, its encoded key columns
+    static key_t Key(const rows_t& rows, size_t row,
+                     const std::vector<key_part_t>& parts,
+                     std::string& tuple) {
+        if (parts.empty()) {
+            return rows.keys[row];
+        }
+        encodeKey(parts, row, tuple);
+        return tuple;
+    }
+    static key_t At(const ch::ColumnRef& column, size_t row) {
+        return column->As<ch::ColumnString>()->At(row);
+    }
+};
+
+/*!
+ * @brief where the key columns are in rows, none for the key alone
+ * @param key the key column of rows.keys, UInt64 if integer
+ * @throw std::runtime_error if a key column wasn't read
+ */
+std::vector<key_part_t> keyParts(const rows_t& rows,
+                                 const std::vector<std::string>& key_columns,
+                                 const std::string& key, bool integer) {
+    std::vector<key_part_t> parts;
+    for (const auto& name: key_columns) {
+        if (name == key) {
+            parts.push_back(integer ?
+                key_part_t{nullptr, &rows.integer_keys, nullptr} :
+                key_part_t{&rows.keys, nullptr, nullptr});
+            continue;
+        }
+        auto column = std::find_if(rows.columns.begin(), rows.columns.end(),
+            [&name] (const column_t& column) { return column.name == name; });
+        if (column == rows.columns.end()) {
+            throw std::runtime_error("key column " + name + " isn't read");
+        }
+        parts.push_back({nullptr, nullptr, &column->data});
+    }
+    return parts;
+}
+}
 /*!
 * @brief creates a table in DB and fills with data from a supplied file
 * @param client Clickhouse client
@@ -30,10 +165,9 @@ ClickhouseFiller::ClickhouseFiller(
             std::string_view table_name,
             const ClickhouseFiller::scheme_t& scheme,
             const std::string& data_file):
-    client_(&client),
-    db_name_{db_name}, table_name_{table_name}, scheme_{scheme}
+    ClickhouseFiller(&client, std::make_shared<ClientSink>(client),
+                     db_name, table_name, scheme)
 {
-    CreateDb();
     if (table_name.empty() || scheme_.size() == 0) {
         return;
     }
@@ -43,11 +177,99 @@ ClickhouseFiller::ClickhouseFiller(
     }
 }
 
+/*!
+ * @brief makes a filler working without a server, e.g. to export
+ *  blocks to a file
+ * @param sink takes the blocks which would be inserted
+ * @throw std::invalid_argument if sink is nullptr
+ * @details nothing is created and the table is taken as empty: only
+ *  values of the same filler are deduplicated and ids start from 1
+ *  unless SetIdGenerator says otherwise
+ */
+ClickhouseFiller::ClickhouseFiller(std::shared_ptr<BlockSink> sink,
+                                   std::string_view db_name):
+    ClickhouseFiller(nullptr, std::move(sink), db_name, "", {})
+{}
+
+ClickhouseFiller::ClickhouseFiller(ch::Client* client,
+                                   std::shared_ptr<BlockSink> sink,
+                                   std::string_view db_name,
+                                   std::string_view table_name,
+                                   const scheme_t& scheme):
+    client_(client), sink_{std::move(sink)},
+    db_name_{db_name}, table_name_{table_name}, scheme_{scheme},
+    block_limits_{g_default_block_limits},
+    block_rows_{g_default_block_limits.max_rows},
+    parse_threads_{std::max(std::thread::hardware_concurrency(), 1u)},
+    readers_{JsonReader{}, NdjsonReader{key_path_, parse_threads_},
+             NativeReader{scheme_t{}}, RowBinaryReader{scheme_t{}},
+             CsvReader{parse_threads_, std::nullopt, {}}}
+{
+    if (!sink_) {
+        throw std::invalid_argument("no block sink");
+    }
+    MakeReaders();
+    CreateDb();
+}
+
+/*!
+ * @brief flushes the insert buffer
+ * @details errors are reported to std::cerr, a destructor can't throw
+ */
+ClickhouseFiller::~ClickhouseFiller() {
+    try {
+        Flush();
+    } catch (const std::exception& e) {
+        std::cerr << "can't flush " << buffer_.ids.size() << " rows to "
+                  << db_name_ << "." << table_name_ << ": "
+                  << e.what() << std::endl;
+    }
+}
+
+/*!
+ * @brief whether the key column is a UInt64 one, deduplicated by
+ *  number instead of by string
+ */
+bool ClickhouseFiller::IntegerKeys() const {
+    return scheme_.size() > 1 && scheme_[1].second == "UInt64";
+}
+
+/*!
+ * @brief the id and the columns rows are deduplicated by
+ * @throw std::runtime_error if a key column isn't in the scheme
+ */
+ClickhouseFiller::scheme_t ClickhouseFiller::KeyScheme() const {
+    if (key_columns_.empty()) {
+        return {scheme_[0], scheme_[1]};
+    }
+    scheme_t key_scheme{scheme_[0]};
+    for (const auto& name: key_columns_) {
+        auto column = std::find_if(scheme_.begin(), scheme_.end(),
+            [&name] (const auto& column) { return column.first == name; });
+        if (column == scheme_.end()) {
+            throw std::runtime_error("key column " + name +
+                                     " isn't in the scheme");
+        }
+        key_scheme.push_back(*column);
+    }
+    return key_scheme;
+}
+
+///> an empty set for the values of the key column(s)
+ClickhouseFiller::src_data_set_t ClickhouseFiller::MakeKeySet() const {
+    if (IntegerKeys() && key_columns_.empty()) {
+        return FlatSet<uint64_t>{};
+    }
+    return KeySet{};
+}
+
 void ClickhouseFiller::CreateDb() {
     std::string query(fmt::format(
         FMT_COMPILE("CREATE DATABASE IF NOT EXISTS {}"), db_name_)
     );
-    client_->Execute(query);
+    if (client_) {
+        client_->Execute(query);
+    }
 }
 
 /*!
@@ -60,53 +282,890 @@ void ClickhouseFiller::CreateDb() {
  */
 void ClickhouseFiller::CreateTable(std::string_view table_name,
                                    const ClickhouseFiller::scheme_t& scheme) {
+    SetTable(table_name, scheme);
+    ExecuteCreate(GetCreationScheme(scheme_));
+}
+
+/*!
+ * @brief makes the following Adds go to table_name of scheme, each
+ *  kept as it is if empty
+ */
+void ClickhouseFiller::SetTable(std::string_view table_name,
+                                const ClickhouseFiller::scheme_t& scheme) {
+    Flush();
     if (!table_name.empty()) {
         table_name_ = table_name;
     }
     if (scheme.size()) {
         scheme_ = scheme;
+        select_scheme_ = {};
+        MakeReaders();
+    }
+}
+
+/*!
+ * @param creation_scheme like "(id UInt64, name String)"
+ */
+void ClickhouseFiller::ExecuteCreate(std::string_view creation_scheme) {
+    std::string engine{"Memory"};
+    if (!engine_.partition_by.empty()) {
+        engine = fmt::format(
+            FMT_COMPILE("MergeTree PARTITION BY {} ORDER BY {}"),
+            engine_.partition_by,
+            engine_.order_by.empty() ? scheme_[1].first : engine_.order_by);
     }
-    /// todo: parametrize ENGINE ?
     std::string query(fmt::format(
-        FMT_COMPILE("CREATE TABLE IF NOT EXISTS {}.{} {}  ENGINE = Memory"),
-        db_name_, table_name_, GetCreationScheme(scheme_))
+        FMT_COMPILE("CREATE TABLE IF NOT EXISTS {}.{} {}  ENGINE = {}"),
+        db_name_, table_name_, creation_scheme, engine)
     );
-    client_->Execute(query);
+    if (client_) {
+        client_->Execute(query);
+    }
 }
 
 /*!
  * @brief inserts data from file into table
  * @param data_file file to read data from
  * @return a number of inserted and a number of duplicated values
+ * @throw std::runtime_error if the file can't be read
  * @warning make sure a table is created
- * @todo make it type generic
+ * @details with an insert buffer set the new rows may be inserted
+ *  by a later Add, Flush or the destructor, yet they are already
+ *  counted as inserted and deduplicate the following Adds
  */
 std::pair<size_t, size_t> ClickhouseFiller::Add(const std::string& data_file) {
-    read_data_t data_to_add = ReadFile(data_file);
-    src_data_set_t current_data;
-    uint64_t current_max_id = Select(current_data);
+    auto result = Add(std::vector<std::string>{data_file}, 1).front();
+    if (!result.error.empty()) {
+        throw std::runtime_error(result.error);
+    }
+    return std::make_pair<>(result.pushed, result.duplicated);
+}
+
+/*!
+ * @brief inserts data from files into table
+ * @param data_files files to read data from
+ * @param threads number of files parsed at once
+ * @return inserted and duplicated values per file, in data_files order
+ * @warning make sure a table is created
+ * @details the table is selected once; the files are parsed in
+ *  parallel but deduplicated and given ids in data_files order, so a
+ *  value is pushed from the first file containing it. A file which
+ *  can't be read gets an error and the rest are still loaded. Without
+ *  files, e.g. all skipped by a manifest, the table isn't selected.
+ */
+std::vector<ClickhouseFiller::file_result_t>
+ClickhouseFiller::Add(const std::vector<std::string>& data_files,
+                      size_t threads) {
+    if (data_files.empty()) {
+        return {};
+    }
+    snapshot_t snapshot = TakeSnapshot();
     std::vector<uint64_t> ids;
-    decltype(data_to_add) hash_ids{}, duplicates{};
+    rows_t rows;
+    std::vector<file_result_t> results;
+    results.reserve(data_files.size());
+    std::vector<size_t> estimates(data_files.size());
+
+    ThreadPool pool(std::min(threads, data_files.size()));
+    std::deque<std::future<rows_t>> parsed;
+    size_t next_file{0};
+    while (results.size() < data_files.size()) {
+        while (next_file < data_files.size() &&
+               parsed.size() < 2 * pool.Size()) {
+            const std::string& data_file = data_files[next_file];
+            size_t& estimate = estimates[next_file++];
+            parsed.push_back(pool.Submit([this, &data_file, &estimate] {
+                return ReadFile(data_file, &estimate);
+            }));
+        }
+        file_result_t result{data_files[results.size()], 0, 0, {}, 0};
+        try {
+            rows_t data_to_add = parsed.front().get();
+            if (size_t estimate = estimates[results.size()]) {
+                ++report_.reserves.reserves;
+                report_.reserves.hits += data_to_add.lines <= estimate;
+            }
+            result.rejected = Reject(result.file, data_to_add, 0);
+            std::tie(result.pushed, result.duplicated) =
+                Dedup(data_to_add, snapshot, ids, rows);
+        } catch (const std::exception& e) {
+            result.error = e.what();
+        }
+        parsed.pop_front();
+        results.push_back(std::move(result));
+        if (rows.size() >= block_limits_.max_rows) {
+            Push(ids, rows, snapshot.max_id);
+        }
+    }
+    Push(ids, rows, snapshot.max_id);
+    Release(snapshot);
+    return results;
+}
 
-    for (const auto& value: data_to_add) {
-        if(current_data.find(value) == current_data.end()) {
-            hash_ids.push_back(value);
-            ids.push_back(++current_max_id);
+/*!
+ * @brief inserts the new ones of rows read or made beforehand
+ * @return a number of inserted and a number of duplicated values
+ */
+std::pair<size_t, size_t> ClickhouseFiller::AddRows(rows_t& data) {
+    snapshot_t snapshot = TakeSnapshot();
+    std::vector<uint64_t> ids;
+    rows_t rows;
+    auto result = Dedup(data, snapshot, ids, rows);
+    Push(ids, rows, snapshot.max_id);
+    Release(snapshot);
+    return result;
+}
+
+/*!
+ * @brief inserts data from a stream as it arrives
+ * @param input stream in the format set by SetFormat, e.g. a pipe
+ * @param chunk_rows max number of rows read before they are pushed
+ * @return a number of inserted and a number of duplicated values
+ * @throw std::invalid_argument if no format is set
+ * @warning make sure a table is created
+ * @details the table is selected once; rows of a line format are
+ *  pushed whenever chunk_rows are read or the producer has nothing more
+ *  ready, so they reach the table while the stream is still open. A
+ *  json document is pushed once it is complete.
+ */
+std::pair<size_t, size_t> ClickhouseFiller::AddStream(std::istream& input,
+                                                      size_t chunk_rows) {
+    if (format_ == format_t::automatic) {
+        throw std::invalid_argument("format of a stream must be set");
+    }
+    chunk_rows = std::max<size_t>(chunk_rows, 1);
+    snapshot_t snapshot = TakeSnapshot();
+    std::vector<uint64_t> ids;
+    rows_t rows, chunk;
+    size_t pushed{0}, duplicated{0}, lines{0};
+    auto push_chunk = [&] {
+        Reject("stream", chunk, lines);
+        lines += chunk.lines;
+        auto [chunk_pushed, chunk_duplicated] =
+            Dedup(chunk, snapshot, ids, rows);
+        pushed += chunk_pushed;
+        duplicated += chunk_duplicated;
+        chunk.clear();
+        Push(ids, rows, snapshot.max_id);
+    };
+
+    readers_.Visit(format_, [&] (const auto& reader) {
+        typedef reader_traits<std::decay_t<decltype(reader)>> traits;
+        typename traits::stream_t stream(reader, input);
+        chunk = stream.Empty();
+        lines = stream.HeaderLines();
+        while (stream.Next(chunk, chunk_rows, true)) {
+            push_chunk();
+        }
+    });
+    push_chunk();
+    Release(snapshot);
+    return std::make_pair<>(pushed, duplicated);
+}
+
+/*!
+ * @brief inserts lines appended to a file until stopped
+ * @param follower the followed file
+ * @param chunk_rows max number of rows pushed at once
+ * @param stopped checked at least once per g_follow_wait
+ * @return a number of inserted and a number of duplicated values
+ * @throw std::invalid_argument if the format isn't line based or the
+ *  file has a header
+ * @warning make sure a table is created
+ * @details with no format set the file is csv. The table is selected
+ *  once and the snapshot is kept up to
+ *  date with the pushed rows, so values inserted by other loaders
+ *  meanwhile aren't seen. The follower's offset is committed after
+ *  every insert, a restarted Follow goes on from it. Rejected lines
+ *  are numbered from the start of the Follow.
+ */
+std::pair<size_t, size_t> ClickhouseFiller::Follow(
+        FileFollower& follower, size_t chunk_rows,
+        const std::atomic<bool>& stopped) {
+    size_t pushed{0}, duplicated{0}, line_count{0};
+    format_t format{format_ == format_t::automatic ? format_t::csv : format_};
+    readers_.Visit(format, [&] (const auto& reader) {
+        typedef reader_traits<std::decay_t<decltype(reader)>> traits;
+        if constexpr (!traits::line_based) {
+            throw std::invalid_argument("only line formats can be followed");
         } else {
-            duplicates.push_back(value);
+            if (reader.HasHeader()) {
+                throw std::invalid_argument(
+                    "a followed file can't have a header");
+            }
+            snapshot_t snapshot = TakeSnapshot();
+            std::vector<uint64_t> ids;
+            read_data_t lines;
+            auto layout = reader.Layout();
+            rows_t rows, values = layout.rows;
+            while (!stopped) {
+                lines.clear();
+                if (!follower.Read(lines, std::max<size_t>(chunk_rows, 1),
+                                   g_follow_wait)) {
+                    continue;
+                }
+                values.clear();
+                for (const auto& line: lines) {
+                    reader.ParseRecord(line, layout, values);
+                }
+                Reject(follower.Path(), values, line_count);
+                line_count += values.lines;
+                auto [lines_pushed, lines_duplicated] =
+                    Dedup(values, snapshot, ids, rows);
+                pushed += lines_pushed;
+                duplicated += lines_duplicated;
+                Push(ids, rows, snapshot.max_id);
+                Flush();
+                follower.Commit();
+            }
+            Release(snapshot);
+        }
+    });
+    return std::make_pair<>(pushed, duplicated);
+}
+
+/*!
+ * @brief inserts data from a line based file keeping a checkpoint
+ * @param data_file file to read data from
+ * @param checkpoint_file where progress is saved after every block
+ * @param resume go on from the checkpoint if there is one
+ * @return a number of inserted and a number of duplicated values,
+ *  including the ones of the resumed runs
+ * @throw std::invalid_argument for json files
+ * @throw std::runtime_error if the checkpoint is of another file
+ * @warning make sure a table is created
+ * @details blocks bypass the insert buffer. A block that was pending
+ *  when a run died is probed for in the table by its first row and
+ *  is either counted as committed or read again, never doubled.
+ *  The committed part of the file is skipped without parsing.
+ *  Like in AddStream and Follow, a csv record can't span lines.
+ *  Rejected lines of a resumed run are numbered from where it resumed.
+ */
+std::pair<size_t, size_t> ClickhouseFiller::AddResumable(
+        const std::string& data_file, const std::string& checkpoint_file,
+        bool resume) {
+    InputFile input(data_file);
+    format_t format = FormatOf(input, data_file);
+    std::pair<size_t, size_t> result;
+    readers_.Visit(format, [&] (const auto& reader) {
+        typedef reader_traits<std::decay_t<decltype(reader)>> traits;
+        if constexpr (!traits::line_based) {
+            throw std::invalid_argument("only line formats can be resumed");
+        } else {
+            typename traits::stream_t stream(reader, input);
+            result = AddResumable(stream, input, data_file, checkpoint_file,
+                                  resume);
+        }
+    });
+    return result;
+}
+
+/*!
+ * @brief AddResumable for the chunk stream of the file's reader
+ * @param input the file the stream reads, its committed part is
+ *  skipped
+ */
+template <typename Stream>
+std::pair<size_t, size_t> ClickhouseFiller::AddResumable(
+        Stream& stream, InputFile& input, const std::string& data_file,
+        const std::string& checkpoint_file, bool resume) {
+    struct stat info{};
+    if (::stat(data_file.c_str(), &info) != 0) {
+        throw std::runtime_error("can't stat file " + data_file);
+    }
+    Checkpoint checkpoint;
+    checkpoint.inode = info.st_ino;
+    if (auto stored = Checkpoint::Load(checkpoint_file); resume && stored) {
+        if (stored->inode != checkpoint.inode) {
+            throw std::runtime_error(checkpoint_file + " is of another file");
+        }
+        checkpoint = std::move(*stored);
+        if (checkpoint.pending) {
+            if (Landed(*checkpoint.pending)) {
+                checkpoint.offset = checkpoint.pending->end;
+                checkpoint.pushed += checkpoint.pending->rows;
+            }
+            checkpoint.pending.reset();
+            checkpoint.Save(checkpoint_file);
+        }
+    }
+    checkpoint.offset = std::max(checkpoint.offset, stream.Offset());
+    uint64_t committed{checkpoint.offset - stream.Offset()};
+    input.Skip(committed);
+    stream.Skipped(committed);
+
+    snapshot_t snapshot = TakeSnapshot();
+    std::vector<uint64_t> ids;
+    rows_t rows, lines = stream.Empty();
+    size_t line_count{stream.HeaderLines()};
+    for (;;) {
+        lines.clear();
+        if (!stream.Next(lines, block_rows_, false)) {
+            break;
+        }
+        uint64_t end{stream.Offset()};
+        Reject(data_file, lines, line_count);
+        line_count += lines.lines;
+        auto [pushed, duplicated] = Dedup(lines, snapshot, ids, rows);
+        if (id_generator_) {
+            id_generator_->Generate(rows.size() - ids.size(),
+                                    snapshot.max_id, ids);
+        }
+        if (rows.size()) {
+            checkpoint.pending = Checkpoint::block_t{
+                checkpoint.offset, end, rows.size(), ids[0],
+                std::string(rows.keys[0])
+            };
+            checkpoint.Save(checkpoint_file);
+            size_t bytes{0};
+            for (size_t i = 0; i < ids.size(); ++i) {
+                bytes += rows.RowBytes(i);
+            }
+            InsertBlock(ids, rows, 0, ids.size(), bytes);
+            checkpoint.pending.reset();
+        }
+        checkpoint.offset = end;
+        checkpoint.pushed += pushed;
+        checkpoint.duplicated += duplicated;
+        checkpoint.Save(checkpoint_file);
+        ids.clear();
+        rows.clear();
+    }
+    Release(snapshot);
+    return std::make_pair<>(checkpoint.pushed, checkpoint.duplicated);
+}
+
+/*!
+ * @brief checks whether a pending block reached the table
+ * @details a block is inserted atomically, so its first row tells
+ */
+bool ClickhouseFiller::Landed(const Checkpoint::block_t& block) {
+    if (!client_) {
+        return false;
+    }
+    uint64_t found{0};
+    std::string query(fmt::format(
+        FMT_COMPILE("SELECT count() FROM {}.{} WHERE {} = {} AND {} = {}"),
+        db_name_, table_name_, scheme_[0].first, block.first_id,
+        scheme_[1].first, quote(block.first_value))
+    );
+    client_->Select(query, [&] (const ch::Block& result) {
+        if (result.GetRowCount()) {
+            found = result[0]->As<ch::ColumnUInt64>()->At(0);
+        }
+    });
+    return found != 0;
+}
+
+/*!
+ * @brief sets the engine of the tables CreateTable creates
+ * @details a partitioned MergeTree lets SetDedupScope name partitions
+ *  and prune the rest
+ */
+void ClickhouseFiller::SetEngine(const ClickhouseFiller::engine_t& engine) {
+    engine_ = engine;
+}
+
+/*!
+ * @brief limits the rows of the table the snapshot selects, e.g. to the
+ *  last days of an event table, instead of its whole history
+ * @param scope a condition and/or partition ids of a MergeTree table;
+ *  empty ones select all rows
+ * @details rows out of the scope aren't deduplicated against. The max
+ *  id is still taken over the whole table, unless an id generator is
+ *  set
+ */
+void ClickhouseFiller::SetDedupScope(
+        const ClickhouseFiller::dedup_scope_t& scope) {
+    dedup_scope_ = scope;
+}
+
+/*!
+ * @brief sets the format of read files instead of sniffing it
+ */
+void ClickhouseFiller::SetFormat(ClickhouseFiller::format_t format) {
+    format_ = format;
+}
+
+/*!
+ * @brief sets where the key of ndjson records is
+ * @param key_path dot separated names, e.g. "driver.hash_id"
+ */
+void ClickhouseFiller::SetKeyPath(std::string_view key_path) {
+    key_path_ = key_path;
+    MakeReaders();
+}
+
+/*!
+ * @brief makes rows duplicates if all of the given columns are equal,
+ *  e.g. {"hash_id", "region", "date"}
+ * @param columns of the scheme but the id; none or the key column
+ *  alone restores deduplication by the key
+ * @throw std::invalid_argument if a column isn't in the scheme or
+ *  is of a type makeColumnData doesn't know
+ * @details the values are encoded into one string kept in a KeySet:
+ *  its 32-bit hash is the fingerprint compared first and the string
+ *  verifies the tuple exactly. Select fetches only these columns, and
+ *  every one of them has to be read from the files, e.g. as csv
+ *  columns
+ */
+void ClickhouseFiller::SetKeyColumns(const std::vector<std::string>& columns) {
+    for (const auto& name: columns) {
+        auto column = scheme_.size() > 1 ? std::find_if(
+            scheme_.begin() + 1, scheme_.end(),
+            [&name] (const auto& column) { return column.first == name; }) :
+            scheme_.end();
+        if (column == scheme_.end()) {
+            throw std::invalid_argument("no column " + name +
+                                        " to deduplicate by");
+        }
+        makeColumnData(column->second);
+    }
+    Flush();
+    key_columns_ = columns;
+    if (columns.size() == 1 && columns[0] == scheme_[1].first) {
+        key_columns_.clear();
+    }
+}
+
+/*!
+ * @brief sets number of threads parsing parts of one csv or ndjson file
+ * @details Add of several files runs that many threads per file
+ */
+void ClickhouseFiller::SetParseThreads(size_t threads) {
+    parse_threads_ = std::max<size_t>(threads, 1);
+    MakeReaders();
+}
+
+/*!
+ * @brief reads csv files as delimited columns instead of a key per line
+ * @param options dialect of the files, std::nullopt for a key per line
+ * @details fields are mapped onto the scheme by the header's names or
+ *  by position: the key column (the scheme's second) first, then the
+ *  rest. The id column is always generated.
+ */
+void ClickhouseFiller::SetCsvOptions(
+        const std::optional<csv_options_t>& options) {
+    csv_options_ = options;
+    MakeReaders();
+}
+
+/*!
+ * @brief makes the readers for the current settings
+ * @throw std::invalid_argument if a column of the scheme has a type
+ *  csv fields can't be parsed into or the key column is neither
+ *  String nor UInt64
+ */
+void ClickhouseFiller::MakeReaders() {
+    scheme_t columns;
+    if (scheme_.size() > 1) {
+        columns.assign(scheme_.begin() + 1, scheme_.end());
+    }
+    std::string key{columns.empty() ? "" : columns[0].first};
+    rules_t rules{rules_};
+    auto& key_rules = rules[key];
+    key_rules.min_length = std::max<size_t>(key_rules.min_length, 1);
+    if (IntegerKeys()) {
+        key_rules.uint64 = true;
+    } else if (!columns.empty() && columns[0].second != "String") {
+        throw std::invalid_argument("key column " + key + " is " +
+                                    columns[0].second +
+                                    ", not String or UInt64");
+    }
+    validators_ = makeValidators(rules);
+    const ColumnValidator& key_validator = validators_.find(key)->second;
+    readers_ = readers_t(
+        JsonReader(key_validator),
+        NdjsonReader(key_path_, parse_threads_, key_validator),
+        NativeReader(columns, key_validator),
+        RowBinaryReader(columns, key_validator),
+        CsvReader(parse_threads_,
+                  columns.empty() ? std::nullopt : csv_options_,
+                  columns, validators_));
+}
+
+/*!
+ * @brief sets checks of the columns' values done while parsing
+ * @param rules by column name; the key column has to be non empty
+ *  whatever its rules say
+ * @throw std::invalid_argument on a bad charset
+ * @throw std::regex_error on a bad regex
+ * @details records failing a check are written to the reject file or,
+ *  without it, fail the load
+ */
+void ClickhouseFiller::SetValidation(const rules_t& rules) {
+    rules_ = rules;
+    MakeReaders();
+}
+
+/*!
+ * @brief makes rejected records go to a file instead of failing loads
+ * @param reject_file appended with lines of the input, the line
+ *  number, the broken rule and the record, tab separated
+ * @throw std::runtime_error if the file can't be opened
+ */
+void ClickhouseFiller::SetRejectFile(const std::string& reject_file) {
+    reject_file_.close();
+    reject_file_.open(reject_file, std::ios::app);
+    if (!reject_file_) {
+        throw std::runtime_error("can't open reject file " + reject_file);
+    }
+}
+
+/*!
+ * @brief writes the rejected records of rows to the reject file
+ * @param input name of the input written along with the records
+ * @param first_line line of the input the rows' lines go on from
+ * @return a number of rejected records, the rows' rejects are cleared
+ * @throw std::runtime_error for the first rejected record if there is
+ *  no reject file
+ */
+size_t ClickhouseFiller::Reject(std::string_view input, rows_t& rows,
+                                size_t first_line) {
+    size_t rejected = rows.rejects.size();
+    if (!rejected) {
+        return 0;
+    }
+    if (!reject_file_.is_open()) {
+        const auto& reject = rows.rejects.front();
+        throw std::runtime_error(fmt::format(
+            FMT_COMPILE("validation failed for line {} ({}): {}"),
+            first_line + reject.line, reject.reason, reject.record));
+    }
+    for (const auto& reject: rows.rejects) {
+        reject_file_ << input << '\t' << first_line + reject.line << '\t'
+                     << reject.reason << '\t';
+        for (char c: reject.record) {
+            switch (c) {
+            case '\t': reject_file_ << "\\t"; break;
+            case '\n': reject_file_ << "\\n"; break;
+            case '\\': reject_file_ << "\\\\"; break;
+            default: reject_file_ << c;
+            }
+        }
+        reject_file_ << '\n';
+    }
+    reject_file_.flush();
+    report_.rejected += rejected;
+    rows.rejects.clear();
+    return rejected;
+}
+
+/*!
+ * @brief selects the values the table (and the insert buffer) holds
+ * @details the set is reserved for the rows of the table, counted
+ *  first; it isn't for the rows the run is going to add, as they may
+ *  be mostly duplicates and an emptier table is slower to probe
+ */
+ClickhouseFiller::snapshot_t ClickhouseFiller::TakeSnapshot() {
+    snapshot_t snapshot{MakeKeySet(), 0};
+    size_t reserved = Count();
+    std::visit([&] (auto& values) { values.reserve(reserved); },
+               snapshot.values);
+    snapshot.max_id = std::max(Select(snapshot.values), buffer_.max_id);
+    if (!id_generator_ && !ScopeCondition().empty()) {
+        snapshot.max_id = std::max(snapshot.max_id, MaxId());
+    }
+    ++report_.reserves.reserves;
+    report_.reserves.hits += std::visit(
+        [&] (const auto& values) { return values.size() <= reserved; },
+        snapshot.values);
+    return snapshot;
+}
+
+/*!
+ * @brief frees the snapshot of a finished run and reports the memory
+ *  it took
+ */
+void ClickhouseFiller::Release(snapshot_t& snapshot) {
+    auto& memory = report_.memory;
+    std::tie(memory.values, memory.bytes) = std::visit(
+        [] (const auto& values) {
+            return std::make_pair(values.size(), values.Capacity());
+        }, snapshot.values);
+    auto start = std::chrono::steady_clock::now();
+    snapshot.values = src_data_set_t{};
+    memory.teardown = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    memory.peak_rss = peakRss();
+}
+
+/*!
+ * @brief moves rows whose keys are missing from snapshot to rows
+ * @param [in, out] snapshot gets the new values and their max id
+ * @param [out] ids ids of the new values unless id_generator_ is set
+ * @return a number of new and a number of duplicated values
+ * @details rows not pushed yet are pushed first if data has other
+ *  columns than them, e.g. a csv file with one more column. UInt64
+ *  keys are parsed once into data.integer_keys, unless a reader did,
+ *  and compared as numbers; composite keys as their encoded tuples.
+ *  The new rows' columns are moved after the loop, a column at a time
+ */
+std::pair<size_t, size_t> ClickhouseFiller::Dedup(rows_t& data,
+                                                  snapshot_t& snapshot,
+                                                  std::vector<uint64_t>& ids,
+                                                  rows_t& rows) {
+    if (!rows.SameColumns(data)) {
+        if (rows.size()) {
+            Push(ids, rows, snapshot.max_id);
+        }
+        rows = data.Like();
+    }
+    bool integer = IntegerKeys();
+    if (integer && data.integer_keys.size() != data.size()) {
+        data.integer_keys.clear();
+        data.integer_keys.reserve(data.size());
+        for (size_t row = 0; row < data.size(); ++row) {
+            data.integer_keys.push_back(
+                key_traits<FlatSet<uint64_t>>::Parse(data.keys[row]));
+        }
+    }
+    std::vector<key_part_t> parts = keyParts(data, key_columns_,
+                                             scheme_[1].first, integer);
+    std::string tuple;
+    std::vector<size_t> new_rows;
+    auto result = std::visit([&] (auto& values) {
+        typedef std::decay_t<decltype(values)> set_t;
+        const set_t* buffered = std::get_if<set_t>(&buffer_.hash_ids_set);
+        size_t pushed{0}, duplicated{0};
+        for (size_t row = 0; row < data.size(); ++row) {
+            auto key = key_traits<set_t>::Key(data, row, parts, tuple);
+            if ((!buffered || !buffered->contains(key)) &&
+                    values.insert(key)) {
+                new_rows.push_back(row);
+                rows.keys.push_back(data.keys[row]);
+                if (integer) {
+                    rows.integer_keys.push_back(data.integer_keys[row]);
+                }
+                if (!id_generator_) {
+                    ids.push_back(++snapshot.max_id);
+                }
+                ++pushed;
+            } else {
+                ++duplicated;
+            }
+        }
+        return std::make_pair<>(pushed, duplicated);
+    }, snapshot.values);
+    rows.MoveColumns(data, new_rows);
+    return result;
+}
+
+/*!
+ * @brief inserts or buffers new rows, generating their ids if needed
+ * @param ids ids of the first rows, the rest are taken from id_generator_
+ * @param rows new rows, cleared with ids afterwards
+ */
+void ClickhouseFiller::Push(std::vector<uint64_t>& ids, rows_t& rows,
+                            uint64_t current_max_id) {
+    if (id_generator_) {
+        id_generator_->Generate(rows.size() - ids.size(),
+                                current_max_id, ids);
+    }
+    if (buffer_limits_) {
+        Buffer(ids, rows);
+    } else {
+        Insert(ids, rows);
+    }
+    ids.clear();
+    rows.clear();
+}
+
+/*!
+ * @brief makes Add coalesce new rows into bigger inserts
+ * @param limits rows, bytes and age of the buffer which trigger a flush
+ * @details the age is checked by Add, there is no background flush
+ */
+void ClickhouseFiller::SetInsertBuffer(
+        const ClickhouseFiller::buffer_limits_t& limits) {
+    buffer_limits_ = limits;
+}
+
+/*!
+ * @brief inserts the buffered rows
+ */
+void ClickhouseFiller::Flush() {
+    if (buffer_.ids.empty()) {
+        return;
+    }
+    Insert(buffer_.ids, buffer_.rows);
+    buffer_ = insert_buffer_t{};
+}
+
+/*!
+ * @brief moves new rows into the insert buffer and flushes it if full
+ * @details rows of other columns than the buffered ones flush it first
+ */
+void ClickhouseFiller::Buffer(std::vector<uint64_t>& ids, rows_t& rows) {
+    if (!buffer_.rows.SameColumns(rows)) {
+        Flush();
+        buffer_.rows = rows.Like();
+    }
+    if (buffer_.ids.empty()) {
+        buffer_.since = std::chrono::steady_clock::now();
+        buffer_.hash_ids_set = MakeKeySet();
+    }
+    std::vector<key_part_t> parts = keyParts(rows, key_columns_,
+                                             scheme_[1].first, IntegerKeys());
+    std::string tuple;
+    std::vector<size_t> all_rows(ids.size());
+    std::visit([&] (auto& hash_ids_set) {
+        typedef key_traits<std::decay_t<decltype(hash_ids_set)>> traits;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            buffer_.bytes += rows.RowBytes(i);
+            buffer_.max_id = std::max(buffer_.max_id, ids[i]);
+            buffer_.ids.push_back(ids[i]);
+            hash_ids_set.insert(traits::Key(rows, i, parts, tuple));
+            buffer_.rows.keys.push_back(rows.keys[i]);
+            all_rows[i] = i;
         }
+    }, buffer_.hash_ids_set);
+    buffer_.rows.integer_keys.insert(buffer_.rows.integer_keys.end(),
+                                     rows.integer_keys.begin(),
+                                     rows.integer_keys.end());
+    buffer_.rows.MoveColumns(rows, all_rows);
+    if (buffer_.ids.size() >= buffer_limits_->max_rows ||
+            buffer_.bytes >= buffer_limits_->max_bytes ||
+            std::chrono::steady_clock::now() - buffer_.since >=
+                buffer_limits_->max_delay) {
+        Flush();
     }
+}
 
+/*!
+ * @brief limits size of blocks sent to the server
+ * @param limits max rows and bytes per block; if adaptive the rows per
+ *  block grow while inserts are faster than target_latency and shrink
+ *  when they are slower or the server pushes back
+ */
+void ClickhouseFiller::SetBlockLimits(
+        const ClickhouseFiller::block_limits_t& limits) {
+    block_limits_ = limits;
+    block_rows_ = limits.adaptive ?
+        std::min(limits.max_rows, g_initial_adaptive_block_rows) :
+        limits.max_rows;
+}
+
+/*!
+ * @return per block statistics of every insert done by the filler
+ */
+const ClickhouseFiller::report_t& ClickhouseFiller::GetReport() const {
+    return report_;
+}
+
+/*!
+ * @brief inserts rows into table block by block
+ * @param ids values of the id column
+ * @param rows values of the hash_id column and the other ones
+ */
+void ClickhouseFiller::Insert(const std::vector<uint64_t>& ids,
+                              const rows_t& rows) {
+    size_t begin{0};
+    while (begin < ids.size()) {
+        size_t end{begin}, bytes{0};
+        while (end < ids.size() && end - begin < block_rows_) {
+            size_t row_bytes = rows.RowBytes(end);
+            if (end != begin &&
+                    bytes + row_bytes > block_limits_.max_bytes) {
+                break;
+            }
+            bytes += row_bytes;
+            ++end;
+        }
+        InsertBlock(ids, rows, begin, end, bytes);
+        begin = end;
+    }
+}
+
+/*!
+ * @brief inserts rows [begin, end) as one block
+ * @throw clickhouse::ServerException if the server keeps rejecting it
+ * @details in adaptive mode a rejected block is retried with backoff
+ *  and the following blocks are halved
+ */
+void ClickhouseFiller::InsertBlock(const std::vector<uint64_t>& ids,
+                                   const rows_t& rows,
+                                   size_t begin, size_t end, size_t bytes) {
     ch::Block block;
-    auto ids_column = std::make_shared<ch::ColumnUInt64>(ids);
-    auto hash_ids_column = std::make_shared<ch::ColumnString>(hash_ids);
+    auto ids_column = std::make_shared<ch::ColumnUInt64>(
+        std::vector<uint64_t>(ids.begin() + begin, ids.begin() + end));
+    ch::ColumnRef hash_ids_column;
+    if (IntegerKeys()) {
+        hash_ids_column = std::make_shared<ch::ColumnUInt64>(
+            std::vector<uint64_t>(rows.integer_keys.begin() + begin,
+                                  rows.integer_keys.begin() + end));
+    } else {
+        auto strings = std::make_shared<ch::ColumnString>();
+        strings->Reserve(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            strings->Append(rows.keys[i]);
+        }
+        hash_ids_column = strings;
+    }
     block.AppendColumn(scheme_[0].first  , ids_column);
     block.AppendColumn(scheme_[1].first, hash_ids_column);
-    client_->Insert(
-        fmt::format(FMT_COMPILE("{}.{}"), db_name_, table_name_),
-        block
-    );
-    return std::make_pair<>(hash_ids.size(), duplicates.size());
+    for (const auto& column: rows.columns) {
+        block.AppendColumn(column.name,
+                           makeColumn(column.data, begin, end));
+    }
+
+    std::string table{
+        fmt::format(FMT_COMPILE("{}.{}"), db_name_, table_name_)
+    };
+    for (size_t retries = 0;; ++retries) {
+        auto start = std::chrono::steady_clock::now();
+        try {
+            sink_->Insert(table, block);
+        } catch (const ch::ServerException& e) {
+            bool backpressure = e.GetCode() == g_too_many_parts ||
+                e.GetCode() == g_too_many_simultaneous_queries;
+            if (!block_limits_.adaptive || !backpressure ||
+                    retries == g_max_block_retries) {
+                throw;
+            }
+            block_rows_ = std::max(block_rows_ / 2, g_min_adaptive_block_rows);
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(100 << retries));
+            continue;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        report_.blocks.push_back({end - begin, bytes, elapsed, retries});
+        if (block_limits_.adaptive) {
+            if (elapsed > block_limits_.target_latency) {
+                block_rows_ = std::max(block_rows_ / 2,
+                                       g_min_adaptive_block_rows);
+            } else if (elapsed < block_limits_.target_latency / 2 &&
+                       end - begin == block_rows_) {
+                block_rows_ = std::min(block_rows_ * 2,
+                                       block_limits_.max_rows);
+            }
+        }
+        return;
+    }
+}
+
+/*!
+ * @brief sets a source of ids used by Add instead of max id + 1
+ * @param id_generator generator, nullptr restores the default
+ * @details needed when several fillers load the same table at once
+ */
+void ClickhouseFiller::SetIdGenerator(
+        std::shared_ptr<IdGenerator> id_generator) {
+    id_generator_ = std::move(id_generator);
+}
+
+/*!
+ * @brief sets where blocks go instead of the server's table
+ * @param sink e.g. a NativeFileSink, nullptr restores the server
+ * @throw std::invalid_argument if nullptr is set without a server
+ */
+void ClickhouseFiller::SetBlockSink(std::shared_ptr<BlockSink> sink) {
+    Flush();
+    if (!sink && !client_) {
+        throw std::invalid_argument("no server to restore as block sink");
+    }
+    sink_ = sink ? std::move(sink) : std::make_shared<ClientSink>(*client_);
 }
 
 /*!
@@ -146,87 +1205,178 @@ std::string ClickhouseFiller::GetSelectScheme(
 }
 
 /*!
- * @brief selects current data from table and returns it
+ * @brief selects the id and the key columns of the table
  * @param [out] container destination
- * @return max id in table
+ * @return max id in table, 0 without a server
+ * @throw std::runtime_error if a key column has another type than the
+ *  one of the scheme
+ * @details only the columns rows are deduplicated by and the rows of
+ *  the dedup scope are transferred; composite keys are encoded as the
+ *  ones of Dedup. A table declared as a struct is selected by its
+ *  compile-time select list unless SetKeyColumns changed the key
  */
 uint64_t
 ClickhouseFiller::Select(ClickhouseFiller::src_data_set_t& container) {
     uint64_t current_max_id{0};
+    if (!client_) {
+        return current_max_id;
+    }
+    scheme_t key_scheme = KeyScheme();
     std::string select_query(
-        fmt::format(FMT_COMPILE("SELECT {} FROM {}.{} ORDER BY id"), /// todo: parametrize ordering
-            GetSelectScheme(scheme_), db_name_, table_name_)
+        fmt::format(FMT_COMPILE("SELECT {} FROM {}.{}{} ORDER BY id"), /// todo: parametrize ordering
+            key_columns_.empty() && !select_scheme_.empty() ?
+                std::string(select_scheme_) : GetSelectScheme(key_scheme),
+            db_name_, table_name_,
+            ScopeCondition())
     );
+    std::string tuple;
     auto on_select = [&] (const ch::Block& block) {
+        ///> HARDCODE assuming the id goes first
+        auto ids = block[0]->As<ch::ColumnUInt64>();
         for (size_t i = 0; i < block.GetRowCount(); ++i) {
-            container.insert(
-               std::string{block[1]->As<ch::ColumnString>()->At(i)} ///> HARDCODE assumings it contains ID
-            );
-            auto id = block[0]->As<ch::ColumnUInt64>()->At(i);  ///> HARDCODE assuming it contains hash_id
-            current_max_id = std::max(id, current_max_id);
+            current_max_id = std::max(ids->At(i), current_max_id);
         }
+        if (!key_columns_.empty()) {
+            std::vector<column_data_t> columns;
+            std::vector<key_part_t> parts;
+            columns.reserve(key_scheme.size() - 1);
+            for (size_t j = 1; j < key_scheme.size(); ++j) {
+                columns.push_back(makeColumnData(key_scheme[j].second));
+                if (!appendColumn(columns.back(), block[j])) {
+                    throw std::runtime_error("column " + key_scheme[j].first +
+                                             " isn't " + key_scheme[j].second);
+                }
+                parts.push_back({nullptr, nullptr, &columns.back()});
+            }
+            auto& values = std::get<KeySet>(container);
+            for (size_t i = 0; i < block.GetRowCount(); ++i) {
+                encodeKey(parts, i, tuple);
+                values.insert(tuple);
+            }
+            return;
+        }
+        std::visit([&] (auto& values) {
+            typedef key_traits<std::decay_t<decltype(values)>> traits;
+            for (size_t i = 0; i < block.GetRowCount(); ++i) {
+                values.insert(traits::At(block[1], i));
+            }
+        }, container);
     };
     client_->Select(select_query, on_select);
     return current_max_id;
 }
 
 /*!
- * @brief reads file and chooses a parser
- * @param data_file [path] + file name
- * @return parsed data
- * @throw std::runtime_error if can't open the file
+ * @return rows in the dedup scope of table, 0 without a server
+ * @details count() of a whole table is answered from the parts'
+ *  metadata, a scoped one reads the scope only
  */
-ClickhouseFiller::read_data_t
-ClickhouseFiller::ReadFile(const std::string& data_file) const {
-    read_data_t res;
-    std::ifstream file(data_file);
-    if (!file.is_open()) {
-        throw std::runtime_error("can't open file " + data_file);
-    }
-    if(data_file.substr(data_file.find_last_of(".") + 1) == "json") {
-        res = ParseJson(file);
-    } else {
-        res = ParseCsv(file);
+uint64_t ClickhouseFiller::Count() {
+    uint64_t count{0};
+    if (!client_) {
+        return count;
     }
-    for (const auto& val: res) {
-        Validate(val);
+    client_->Select(
+        fmt::format(FMT_COMPILE("SELECT count() FROM {}.{}{}"),
+                    db_name_, table_name_, ScopeCondition()),
+        [&count] (const ch::Block& block) {
+            if (block.GetRowCount()) {
+                count = block[0]->As<ch::ColumnUInt64>()->At(0);
+            }
+        });
+    return count;
+}
+
+/*!
+ * @return max id of the whole table, 0 without a server
+ */
+uint64_t ClickhouseFiller::MaxId() {
+    uint64_t max_id{0};
+    if (!client_) {
+        return max_id;
     }
-    return res;
+    client_->Select(
+        fmt::format(FMT_COMPILE("SELECT max({}) FROM {}.{}"),
+                    scheme_[0].first, db_name_, table_name_),
+        [&max_id] (const ch::Block& block) {
+            if (block.GetRowCount()) {
+                max_id = block[0]->As<ch::ColumnUInt64>()->At(0);
+            }
+        });
+    return max_id;
 }
 
 /*!
- * @brief reads and parses json file
- * @param data_file path to a json file
- * @return vectorized data from file
- * @details file as {"data": {"drivers": [..., ...]} }
+ * @return " WHERE ..." of the dedup scope, empty without one
  */
-ClickhouseFiller::read_data_t
-ClickhouseFiller::ParseJson(std::ifstream& file) const {
-    nlohmann::json j;
-    file >> j;
-    return j["data"]["drivers"].get<ClickhouseFiller::read_data_t>();
+std::string ClickhouseFiller::ScopeCondition() const {
+    std::vector<std::string> conditions;
+    if (!dedup_scope_.where.empty()) {
+        conditions.push_back(
+            fmt::format(FMT_COMPILE("({})"), dedup_scope_.where));
+    }
+    if (!dedup_scope_.partitions.empty()) {
+        std::vector<std::string> partitions;
+        for (const auto& partition: dedup_scope_.partitions) {
+            partitions.push_back(quote(partition));
+        }
+        conditions.push_back(fmt::format(
+            FMT_COMPILE("_partition_id IN ({})"),
+            fmt::join(partitions, FMT_COMPILE(", "))));
+    }
+    if (conditions.empty()) {
+        return {};
+    }
+    return fmt::format(FMT_COMPILE(" WHERE {}"),
+                       fmt::join(conditions, FMT_COMPILE(" AND ")));
 }
 
 /*!
- * @brief reads file line by line
- * @param data_file path to the csv file
- * @return vectorized data from file
+ * @brief reads file and chooses a parser
+ * @param data_file [path] + file name
+ * @param [out] estimate lines of a line format file going by its first
+ *  bytes and (decompressed) size, which its reader reserves the rows
+ *  by; 0 if unknown, e.g. for a pipe
+ * @return parsed data
+ * @throw std::runtime_error if can't open or decompress the file
+ * @details gzip, zstd and lz4 files are detected by their magic bytes
+ *  and decompressed on the fly; unless SetFormat was called the format
+ *  is sniffed from the first decompressed bytes
  */
-ClickhouseFiller::read_data_t
-ClickhouseFiller::ParseCsv(std::ifstream& file) const
-{
-    std::vector<ClickhouseFiller::src_data_t> res;
-    for (std::string line; std::getline(file, line);)
-        res.push_back(line);
+rows_t ClickhouseFiller::ReadFile(const std::string& data_file,
+                                  size_t* estimate) const {
+    rows_t res;
+    InputFile file(data_file);
+    readers_.Visit(FormatOf(file, data_file), [&] (const auto& reader) {
+        typedef reader_traits<std::decay_t<decltype(reader)>> traits;
+        if constexpr (traits::line_based) {
+            if (estimate) {
+                *estimate = estimateLines(file.Head(g_sniff_bytes),
+                                          file.ContentSize());
+            }
+        }
+        res = reader.Read(file);
+    });
     return res;
 }
 
-void ClickhouseFiller::Validate(const ClickhouseFiller::src_data_t& data) const
-{
-    using namespace std::string_literals;
-    if(data.empty()) {
-        throw std::runtime_error("validation failed for: "s + data);
+/*!
+ * @brief format set by SetFormat or sniffed from the file's content
+ * @details the extension, the one before the compression one for a
+ *  compressed file, e.g. data.ndjson.zst, only breaks ties
+ */
+ClickhouseFiller::format_t
+ClickhouseFiller::FormatOf(InputFile& file, std::string_view name) const {
+    if (format_ != format_t::automatic) {
+        return format_;
+    }
+    if (file.Compression() != compression_t::none) {
+        name = name.substr(0, name.find_last_of("."));
     }
+    size_t dot = name.find_last_of(".");
+    std::string_view extension = dot == std::string_view::npos ?
+        std::string_view{} : name.substr(dot + 1);
+    return readers_.Detect(file.Head(g_sniff_bytes), extension);
 }
 
 /*!
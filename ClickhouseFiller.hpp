@@ -7,51 +7,258 @@
 #pragma once
 #include <string_view>
 #include <string>
+#include <chrono>
+#include <optional>
+#include <atomic>
 #include <vector>
 #include <utility>
-#include <unordered_set>
+#include <variant>
+#include <istream>
 #include <fstream>
 #include <memory>
 #include <clickhouse/client.h>
 
+#include "BlockSink.hpp"
+#include "Checkpoint.hpp"
+#include "ColumnValidator.hpp"
+#include "FileFollower.hpp"
+#include "FlatSet.hpp"
+#include "IdAllocator.hpp"
+#include "Readers.hpp"
+#include "StringPool.hpp"
+#include "TableSchema.hpp"
+
+class InputFile;
+
 class ClickhouseFiller final {
 public:
     typedef std::vector<std::pair<std::string, std::string>> scheme_t;
     typedef std::string src_data_t;
-    typedef std::unordered_set<ClickhouseFiller::src_data_t>
-        src_data_set_t;
+    ///> values of a String key column or of a UInt64 one
+    typedef std::variant<KeySet, FlatSet<uint64_t>> src_data_set_t;
+    ///> thresholds of the insert buffer, the first one reached flushes it
+    struct buffer_limits_t {
+        size_t max_rows;
+        size_t max_bytes;
+        std::chrono::milliseconds max_delay;
+    };
+    ///> size of inserted blocks; adaptive tunes rows by insert latency
+    struct block_limits_t {
+        size_t max_rows;
+        size_t max_bytes;
+        bool adaptive;
+        std::chrono::milliseconds target_latency;
+    };
+    struct block_report_t {
+        size_t rows;
+        size_t bytes;
+        std::chrono::microseconds elapsed;
+        size_t retries;
+    };
+    ///> memory the table's values took during the last run
+    struct memory_report_t {
+        size_t values;
+        size_t bytes;           ///> held by the set of the values
+        std::chrono::microseconds teardown;
+        size_t peak_rss;        ///> bytes, of the whole process
+    };
+    /*!
+     * @brief reservations made up front from estimates, the snapshot of
+     *  each run and the rows of each file, and how many were enough
+     */
+    struct reserve_report_t {
+        size_t reserves;
+        size_t hits;
+    };
+    ///> statistics of the filler's inserts
+    struct report_t {
+        std::vector<block_report_t> blocks;
+        size_t rejected{0};     ///> records which failed validation
+        memory_report_t memory{};
+        reserve_report_t reserves{};
+    };
+    ///> ENGINE of created tables: Memory unless partition_by is set
+    struct engine_t {
+        std::string partition_by;   ///> of a MergeTree, e.g. "toYYYYMM(date)"
+        std::string order_by;       ///> MergeTree sorting key, the key if empty
+    };
+    ///> rows of the table new ones are deduplicated against, all if empty
+    struct dedup_scope_t {
+        std::string where;          ///> e.g. "date >= today() - 7"
+        std::vector<std::string> partitions;    ///> ids, e.g. "202410"
+    };
+    ///> ndjson keys are found by SetKeyPath
+    typedef input_format_t format_t;
+    struct file_result_t {
+        std::string file;
+        size_t pushed;
+        size_t duplicated;
+        std::string error;
+        size_t rejected;
+    };
     ClickhouseFiller(clickhouse::Client& client,
                      std::string_view db_name,
                      std::string_view table_name = "",
                      const scheme_t& scheme = {},
                      const std::string& data_file = "");
+    ClickhouseFiller(std::shared_ptr<BlockSink> sink,
+                     std::string_view db_name);
 
     void CreateTable(std::string_view table_name = "",
                       const scheme_t& scheme = {});
+    template <typename Table>
+    void CreateTable(std::string_view table_name);
     void DropTable();
     std::pair<size_t, size_t> Add(const std::string& data_file);
+    std::vector<file_result_t> Add(const std::vector<std::string>& data_files,
+                                   size_t threads);
+    template <typename Table>
+    std::pair<size_t, size_t> AddRecords(const std::vector<Table>& records);
+    std::pair<size_t, size_t> AddStream(std::istream& input, size_t chunk_rows);
+    std::pair<size_t, size_t> Follow(FileFollower& follower, size_t chunk_rows,
+                                     const std::atomic<bool>& stopped);
+    std::pair<size_t, size_t> AddResumable(const std::string& data_file,
+                                           const std::string& checkpoint_file,
+                                           bool resume);
+    void SetEngine(const engine_t& engine);
+    void SetDedupScope(const dedup_scope_t& scope);
+    void SetFormat(format_t format);
+    void SetKeyPath(std::string_view key_path);
+    void SetKeyColumns(const std::vector<std::string>& columns);
+    void SetParseThreads(size_t threads);
+    void SetCsvOptions(const std::optional<csv_options_t>& options);
+    void SetValidation(const rules_t& rules);
+    void SetRejectFile(const std::string& reject_file);
+    void SetIdGenerator(std::shared_ptr<IdGenerator> id_generator);
+    void SetBlockSink(std::shared_ptr<BlockSink> sink);
+    void SetInsertBuffer(const buffer_limits_t& limits);
+    void Flush();
+    void SetBlockLimits(const block_limits_t& limits);
+    const report_t& GetReport() const;
 
-    ~ClickhouseFiller() = default;
+    ~ClickhouseFiller();
 private:    
     typedef std::vector<src_data_t> read_data_t;
 
+    ///> values of the table as of the last Select and the ones added since
+    struct snapshot_t {
+        src_data_set_t values;
+        uint64_t max_id;
+    };
+
+    ///> rows accepted by Add but not inserted yet
+    struct insert_buffer_t {
+        std::vector<uint64_t> ids;
+        rows_t rows;
+        src_data_set_t hash_ids_set;
+        size_t bytes{0};
+        uint64_t max_id{0};
+        std::chrono::steady_clock::time_point since;
+    };
+
+    ClickhouseFiller(clickhouse::Client* client,
+                     std::shared_ptr<BlockSink> sink,
+                     std::string_view db_name,
+                     std::string_view table_name,
+                     const scheme_t& scheme);
+
+    void SetTable(std::string_view table_name, const scheme_t& scheme);
+    void ExecuteCreate(std::string_view creation_scheme);
+    std::pair<size_t, size_t> AddRows(rows_t& data);
     static std::string GetCreationScheme(const scheme_t& scheme);
     static std::string GetSelectScheme(const scheme_t& scheme);
 
-    ///> todo: use stategy pattern?
-    read_data_t ReadFile(const std::string& data_file) const;
-    read_data_t ParseJson(std::ifstream& file) const;
-    read_data_t ParseCsv(std::ifstream& file) const;
-    void Validate(const src_data_t& data) const;
+    template <typename Stream>
+    std::pair<size_t, size_t> AddResumable(Stream& stream, InputFile& input,
+                                           const std::string& data_file,
+                                           const std::string& checkpoint_file,
+                                           bool resume);
+    rows_t ReadFile(const std::string& data_file,
+                    size_t* estimate = nullptr) const;
+    format_t FormatOf(InputFile& file, std::string_view name) const;
+    size_t Reject(std::string_view input, rows_t& rows, size_t first_line);
     ///<
 
     void CreateDb();
+    bool IntegerKeys() const;
+    scheme_t KeyScheme() const;
+    src_data_set_t MakeKeySet() const;
 
-    /// todo: implement for each type using templates ?
     uint64_t Select(src_data_set_t& container);
+    uint64_t Count();
+    uint64_t MaxId();
+    std::string ScopeCondition() const;
+    void Insert(const std::vector<uint64_t>& ids, const rows_t& rows);
+    void InsertBlock(const std::vector<uint64_t>& ids,
+                     const rows_t& rows,
+                     size_t begin, size_t end, size_t bytes);
+    snapshot_t TakeSnapshot();
+    void Release(snapshot_t& snapshot);
+    bool Landed(const Checkpoint::block_t& block);
+    std::pair<size_t, size_t> Dedup(rows_t& data, snapshot_t& snapshot,
+                                    std::vector<uint64_t>& ids,
+                                    rows_t& rows);
+    void Push(std::vector<uint64_t>& ids, rows_t& rows,
+              uint64_t current_max_id);
+    void Buffer(std::vector<uint64_t>& ids, rows_t& rows);
+    void MakeReaders();
 
-    clickhouse::Client* client_;
+    clickhouse::Client* client_;    ///> nullptr without a server
+    std::shared_ptr<BlockSink> sink_;
     std::string db_name_;
     std::string table_name_;
     scheme_t scheme_;
+    engine_t engine_;
+    dedup_scope_t dedup_scope_;
+    std::shared_ptr<IdGenerator> id_generator_;
+    std::optional<buffer_limits_t> buffer_limits_;
+    insert_buffer_t buffer_;
+    block_limits_t block_limits_;
+    size_t block_rows_;
+    report_t report_;
+    format_t format_{format_t::automatic};
+    std::string key_path_{"hash_id"};
+    ///> columns rows are deduplicated by, empty for the key alone
+    std::vector<std::string> key_columns_;
+    ///> select list of a table declared as a struct, else empty
+    std::string_view select_scheme_;
+    size_t parse_threads_;
+    std::optional<csv_options_t> csv_options_;
+    rules_t rules_;
+    validators_t validators_;
+    std::ofstream reject_file_;
+    readers_t readers_;
 };
+
+/*!
+ * @brief creates a table declared as a struct, see TableSchema.hpp
+ * @param table_name table to be created, the current one if empty
+ * @details the DDL and the select list are made at compile time
+ */
+template <typename Table>
+void ClickhouseFiller::CreateTable(std::string_view table_name) {
+    SetTable(table_name, table_schema<Table>::Scheme());
+    select_scheme_ = table_schema<Table>::SelectScheme();
+    ExecuteCreate(table_schema<Table>::CreationScheme());
+}
+
+/*!
+ * @brief inserts records of a table declared as a struct
+ * @return a number of inserted and a number of duplicated values
+ * @throw std::invalid_argument if the table has another scheme
+ * @details the ids of records are ignored, they are assigned as by Add;
+ *  records aren't validated. The snapshot is selected by the
+ *  compile-time select list of Table, the records are copied into
+ *  columns_t by typed loops and go on as read rows
+ */
+template <typename Table>
+std::pair<size_t, size_t>
+ClickhouseFiller::AddRecords(const std::vector<Table>& records) {
+    if (scheme_ != table_schema<Table>::Scheme()) {
+        throw std::invalid_argument("records don't match the scheme of " +
+                                    table_name_);
+    }
+    select_scheme_ = table_schema<Table>::SelectScheme();
+    rows_t data = table_schema<Table>::Rows(records);
+    return AddRows(data);
+}
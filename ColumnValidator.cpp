@@ -0,0 +1,180 @@
+#include "ColumnValidator.hpp"
+#include "nlohmann_json/json.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+/*!
+ * @brief parses "a-z0-9_" into the set of allowed bytes
+ * @details a '-' first or last is literal
+ */
+std::bitset<256> parseCharset(std::string_view charset) {
+    std::bitset<256> allowed;
+    for (size_t i = 0; i < charset.size(); ++i) {
+        auto first = static_cast<unsigned char>(charset[i]);
+        auto last = first;
+        if (i + 2 < charset.size() && charset[i + 1] == '-') {
+            last = static_cast<unsigned char>(charset[i + 2]);
+            i += 2;
+        }
+        if (last < first) {
+            throw std::invalid_argument("bad charset range in " +
+                                        std::string(charset));
+        }
+        for (unsigned c = first; c <= last; ++c) {
+            allowed.set(c);
+        }
+    }
+    return allowed;
+}
+
+/*!
+ * @brief whether text is well formed UTF-8: no overlong forms,
+ *  surrogates or code points past U+10FFFF
+ */
+bool isUtf8(std::string_view text) {
+    constexpr uint64_t high_bits{0x8080808080808080ULL};
+    auto p = reinterpret_cast<const unsigned char*>(text.data());
+    auto end = p + text.size();
+    while (p != end) {
+        if (end - p >= 8) {
+            uint64_t word;
+            std::memcpy(&word, p, sizeof(word));
+            if ((word & high_bits) == 0) {
+                p += 8;
+                continue;
+            }
+        }
+        if (*p < 0x80) {
+            ++p;
+            continue;
+        }
+        // lead byte mask, length and the least code point of that length
+        static constexpr struct {
+            unsigned char mask, lead;
+            size_t length;
+            uint32_t min_code_point;
+        } forms[]{
+            {0xe0, 0xc0, 2, 0x80},
+            {0xf0, 0xe0, 3, 0x800},
+            {0xf8, 0xf0, 4, 0x10000},
+        };
+        size_t length{0};
+        uint32_t code_point{0}, min_code_point{0};
+        for (const auto& form: forms) {
+            if ((*p & form.mask) == form.lead) {
+                length = form.length;
+                code_point = *p & ~form.mask & 0xff;
+                min_code_point = form.min_code_point;
+                break;
+            }
+        }
+        if (!length) {
+            return false;
+        }
+        if (static_cast<size_t>(end - p) < length) {
+            return false;
+        }
+        for (size_t i = 1; i < length; ++i) {
+            if ((p[i] & 0xc0) != 0x80) {
+                return false;
+            }
+            code_point = (code_point << 6) | (p[i] & 0x3f);
+        }
+        if (code_point < min_code_point || code_point > 0x10ffff ||
+                (code_point >= 0xd800 && code_point <= 0xdfff)) {
+            return false;
+        }
+        p += length;
+    }
+    return true;
+}
+}
+
+rules_t loadRules(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("can't open rules file " + path);
+    }
+    nlohmann::json json;
+    try {
+        file >> json;
+    } catch (const nlohmann::json::exception& e) {
+        throw std::runtime_error("can't parse " + path + ": " + e.what());
+    }
+    rules_t rules;
+    for (const auto& [column, column_json]: json.items()) {
+        column_rules_t& column_rules = rules[column];
+        column_rules.min_length =
+            column_json.value("min_length", column_rules.min_length);
+        column_rules.max_length =
+            column_json.value("max_length", column_rules.max_length);
+        column_rules.charset = column_json.value("charset", "");
+        column_rules.utf8 = column_json.value("utf8", false);
+        column_rules.regex = column_json.value("regex", "");
+        column_rules.uint64 = column_json.value("uint64", false);
+    }
+    return rules;
+}
+
+/*!
+ * @throw std::invalid_argument on a bad charset range
+ * @throw std::regex_error on a bad regex
+ */
+ColumnValidator::ColumnValidator(const column_rules_t& rules):
+    min_length_{rules.min_length}, max_length_{rules.max_length},
+    utf8_{rules.utf8}, uint64_{rules.uint64}
+{
+    if (!rules.charset.empty()) {
+        charset_ = parseCharset(rules.charset);
+    }
+    if (!rules.regex.empty()) {
+        regex_.emplace(rules.regex, std::regex::ECMAScript |
+                                    std::regex::optimize);
+    }
+}
+
+const char* ColumnValidator::Check(std::string_view value) const {
+    if (value.size() < min_length_) {
+        return "too short";
+    }
+    if (value.size() > max_length_) {
+        return "too long";
+    }
+    if (charset_) {
+        bool allowed{true};
+        for (char c: value) {
+            allowed &= (*charset_)[static_cast<unsigned char>(c)];
+        }
+        if (!allowed) {
+            return "character out of charset";
+        }
+    }
+    if (uint64_) {
+        uint64_t number;
+        auto [end, error] = std::from_chars(value.data(),
+                                            value.data() + value.size(),
+                                            number);
+        if (error != std::errc{} || end != value.data() + value.size()) {
+            return "not a UInt64";
+        }
+    }
+    if (utf8_ && !isUtf8(value)) {
+        return "invalid UTF-8";
+    }
+    if (regex_ && !std::regex_match(value.begin(), value.end(), *regex_)) {
+        return "regex mismatch";
+    }
+    return nullptr;
+}
+
+validators_t makeValidators(const rules_t& rules) {
+    validators_t validators;
+    for (const auto& [column, column_rules]: rules) {
+        validators.emplace(column, ColumnValidator(column_rules));
+    }
+    return validators;
+}
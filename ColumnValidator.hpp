@@ -0,0 +1,53 @@
+#pragma once
+#include <bitset>
+#include <limits>
+#include <map>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+
+///> declarative checks of the values of one column
+struct column_rules_t {
+    size_t min_length{0};   ///> in bytes
+    size_t max_length{std::numeric_limits<size_t>::max()};
+    std::string charset;    ///> allowed bytes, e.g. "a-z0-9_"; any if empty
+    bool utf8{false};       ///> has to be valid UTF-8
+    std::string regex;      ///> ECMAScript, has to match the whole value
+    bool uint64{false};     ///> has to be a decimal UInt64
+};
+
+///> rules by column name
+typedef std::map<std::string, column_rules_t> rules_t;
+
+/*!
+ * @brief reads rules from a json file like
+ *  {"hash_id": {"min_length": 4, "charset": "a-z0-9_", "utf8": true}}
+ * @throw std::runtime_error if the file can't be read or parsed
+ */
+rules_t loadRules(const std::string& path);
+
+/*!
+ * @brief checks values against column_rules_t compiled once
+ * @details cheap checks go first; the UTF-8 check skips ASCII 8 bytes
+ *  at a time and the regex runs last
+ */
+class ColumnValidator final {
+public:
+    explicit ColumnValidator(const column_rules_t& rules);
+
+    ///> nullptr if value passes, otherwise the broken rule
+    const char* Check(std::string_view value) const;
+private:
+    size_t min_length_;
+    size_t max_length_;
+    std::optional<std::bitset<256>> charset_;
+    bool utf8_;
+    std::optional<std::regex> regex_;
+    bool uint64_;
+};
+
+///> validators by column name
+typedef std::map<std::string, ColumnValidator, std::less<>> validators_t;
+
+validators_t makeValidators(const rules_t& rules);
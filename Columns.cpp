@@ -0,0 +1,450 @@
+#include "Columns.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+namespace ch = clickhouse;
+
+namespace {
+template <typename T>
+constexpr bool g_is_string = std::is_same_v<T, std::string>;
+
+constexpr int64_t g_seconds_per_day{24 * 60 * 60};
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "binary formats are decoded by memcpy");
+
+template <typename T>
+void eraseRows(std::vector<T>& values, const std::vector<size_t>& rows) {
+    size_t to{rows.empty() ? values.size() : rows[0]}, next{0};
+    for (size_t from = to; from < values.size(); ++from) {
+        if (next < rows.size() && rows[next] == from) {
+            ++next;
+            continue;
+        }
+        values[to++] = std::move(values[from]);
+    }
+    values.resize(to);
+}
+
+///> a field of digits only, no sign
+template <typename T>
+bool parseNumber(std::string_view field, T& value) {
+    auto [end, error] = std::from_chars(field.data(),
+                                        field.data() + field.size(), value);
+    return error == std::errc{} && end == field.data() + field.size();
+}
+
+///> days since 1970-01-01 of a proleptic Gregorian date
+int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    auto of_era = static_cast<unsigned>(year - era * 400);
+    unsigned of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 +
+        day - 1;
+    unsigned days = of_era * 365 + of_era / 4 - of_era / 100 + of_year;
+    return era * 146097 + static_cast<int64_t>(days) - 719468;
+}
+
+///> "YYYY-MM-DD" as days since 1970-01-01
+bool parseDays(std::string_view field, int64_t& days) {
+    static constexpr unsigned month_days[]{
+        31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    unsigned year{0}, month{0}, day{0};
+    if (field.size() != 10 || field[4] != '-' || field[7] != '-' ||
+            !parseNumber(field.substr(0, 4), year) ||
+            !parseNumber(field.substr(5, 2), month) ||
+            !parseNumber(field.substr(8, 2), day) ||
+            month < 1 || month > 12 || day < 1 || day > month_days[month - 1]) {
+        return false;
+    }
+    bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    if (month == 2 && day == 29 && !leap) {
+        return false;
+    }
+    days = daysFromCivil(year, month, day);
+    return true;
+}
+
+bool parseDate(std::string_view field, date_t& date) {
+    int64_t days{0};
+    if (!parseDays(field, days) || days < 0 ||
+            days > std::numeric_limits<uint16_t>::max()) {
+        return false;
+    }
+    date.days = static_cast<uint16_t>(days);
+    return true;
+}
+
+///> "YYYY-MM-DD hh:mm:ss" (or with a T) in UTC, or a unix timestamp
+bool parseDateTime(std::string_view field, date_time_t& time) {
+    if (field.find_first_not_of("0123456789") == std::string_view::npos) {
+        return parseNumber(field, time.seconds);
+    }
+    int64_t days{0};
+    unsigned hours{0}, minutes{0}, seconds{0};
+    if (field.size() != 19 || (field[10] != ' ' && field[10] != 'T') ||
+            field[13] != ':' || field[16] != ':' ||
+            !parseDays(field.substr(0, 10), days) ||
+            !parseNumber(field.substr(11, 2), hours) ||
+            !parseNumber(field.substr(14, 2), minutes) ||
+            !parseNumber(field.substr(17, 2), seconds) ||
+            hours > 23 || minutes > 59 || seconds > 59) {
+        return false;
+    }
+    int64_t total = days * g_seconds_per_day + hours * 3600 + minutes * 60 +
+        seconds;
+    if (total < 0 || total > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+    time.seconds = static_cast<uint32_t>(total);
+    return true;
+}
+}
+
+void rows_t::reserve(size_t rows, size_t key_bytes) {
+    keys.reserve(rows, key_bytes);
+    for (auto& column: columns) {
+        std::visit([rows] (auto& values) { values.reserve(rows); },
+                   column.data);
+    }
+}
+
+void rows_t::clear() {
+    Truncate(0);
+    rejects.clear();
+    lines = 0;
+}
+
+void rows_t::Truncate(size_t rows) {
+    keys.Truncate(rows);
+    integer_keys.resize(std::min(integer_keys.size(), rows));
+    for (auto& column: columns) {
+        std::visit([rows] (auto& values) {
+            values.resize(std::min(values.size(), rows));
+        }, column.data);
+    }
+}
+
+void rows_t::Erase(const std::vector<size_t>& rows) {
+    keys.Erase(rows);
+    if (!integer_keys.empty()) {
+        eraseRows(integer_keys, rows);
+    }
+    for (auto& column: columns) {
+        std::visit([&rows] (auto& values) { eraseRows(values, rows); },
+                   column.data);
+    }
+}
+
+rows_t rows_t::Like() const {
+    rows_t rows;
+    for (const auto& column: columns) {
+        rows.columns.push_back({column.name, std::visit([] (const auto& values) {
+            return column_data_t{std::decay_t<decltype(values)>{}};
+        }, column.data)});
+    }
+    return rows;
+}
+
+bool rows_t::SameColumns(const rows_t& other) const {
+    if (columns.size() != other.columns.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].name != other.columns[i].name ||
+                columns[i].data.index() != other.columns[i].data.index()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void rows_t::MoveColumns(rows_t& from, const std::vector<size_t>& rows) {
+    for (size_t i = 0; i < columns.size(); ++i) {
+        std::visit([&] (auto& values) {
+            auto& from_values =
+                std::get<std::decay_t<decltype(values)>>(from.columns[i].data);
+            values.reserve(values.size() + rows.size());
+            for (size_t row: rows) {
+                values.push_back(std::move(from_values[row]));
+            }
+        }, columns[i].data);
+    }
+}
+
+size_t rows_t::ColumnBytes(size_t row) const {
+    size_t bytes{0};
+    for (const auto& column: columns) {
+        bytes += std::visit([row] (const auto& values) -> size_t {
+            typedef typename std::decay_t<decltype(values)>::value_type
+                value_t;
+            if constexpr (g_is_string<value_t>) {
+                return values[row].size() + 1;
+            } else {
+                return sizeof(value_t);
+            }
+        }, column.data);
+    }
+    return bytes;
+}
+
+size_t rows_t::RowBytes(size_t row) const {
+    size_t key_bytes = integer_keys.empty() ?
+        keys[row].size() + 1 : sizeof(integer_keys[row]);
+    return sizeof(uint64_t) + key_bytes + ColumnBytes(row);
+}
+
+column_data_t makeColumnData(std::string_view type) {
+    static const std::pair<std::string_view, column_data_t> types[]{
+        {"String", std::vector<std::string>{}},
+        {"UInt8", std::vector<uint8_t>{}},
+        {"UInt16", std::vector<uint16_t>{}},
+        {"UInt32", std::vector<uint32_t>{}},
+        {"UInt64", std::vector<uint64_t>{}},
+        {"Int8", std::vector<int8_t>{}},
+        {"Int16", std::vector<int16_t>{}},
+        {"Int32", std::vector<int32_t>{}},
+        {"Int64", std::vector<int64_t>{}},
+        {"Float32", std::vector<float>{}},
+        {"Float64", std::vector<double>{}},
+        {"Date", std::vector<date_t>{}},
+        {"DateTime", std::vector<date_time_t>{}},
+    };
+    if (type.substr(0, 9) == "DateTime(") {
+        type = "DateTime";  // a time zone only changes how it's shown
+    }
+    for (const auto& [name, data]: types) {
+        if (name == type) {
+            return data;
+        }
+    }
+    throw std::invalid_argument("unsupported column type " +
+                                std::string(type));
+}
+
+bool appendField(column_data_t& data, std::string_view field) {
+    return std::visit([field] (auto& values) {
+        typedef typename std::decay_t<decltype(values)>::value_type value_t;
+        if constexpr (g_is_string<value_t>) {
+            values.emplace_back(field);
+        } else if constexpr (std::is_same_v<value_t, date_t>) {
+            date_t date{};
+            if (!parseDate(field, date)) {
+                return false;
+            }
+            values.push_back(date);
+        } else if constexpr (std::is_same_v<value_t, date_time_t>) {
+            date_time_t time{};
+            if (!parseDateTime(field, time)) {
+                return false;
+            }
+            values.push_back(time);
+        } else {
+            value_t value{};
+            auto [end, error] = std::from_chars(field.data(),
+                field.data() + field.size(), value);
+            if (error != std::errc{} || end != field.data() + field.size()) {
+                return false;
+            }
+            values.push_back(value);
+        }
+        return true;
+    }, data);
+}
+
+bool decodeVarint(uint64_t& value, const char*& begin, const char* end) {
+    value = 0;
+    for (unsigned shift = 0; begin != end && shift < 64; shift += 7) {
+        auto byte = static_cast<unsigned char>(*begin++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void encodeVarint(uint64_t value, std::string& to) {
+    do {
+        to.push_back(static_cast<char>((value & 0x7f) | (value > 0x7f) << 7));
+        value >>= 7;
+    } while (value);
+}
+
+std::string quote(std::string_view value) {
+    std::string quoted{"'"};
+    for (char c: value) {
+        if (c == '\\' || c == '\'') {
+            quoted.push_back('\\');
+        }
+        quoted.push_back(c);
+    }
+    quoted.push_back('\'');
+    return quoted;
+}
+
+bool decodeBinary(column_data_t& data, size_t rows, const char*& begin,
+                  const char* end) {
+    return std::visit([&] (auto& values) {
+        typedef typename std::decay_t<decltype(values)>::value_type value_t;
+        if constexpr (g_is_string<value_t>) {
+            if (values.capacity() < values.size() + rows) {
+                values.reserve(std::max(values.size() + rows,
+                                        2 * values.capacity()));
+            }
+            for (size_t i = 0; i < rows; ++i) {
+                uint64_t size{0};
+                if (!decodeVarint(size, begin, end) ||
+                        size > static_cast<uint64_t>(end - begin)) {
+                    return false;
+                }
+                values.emplace_back(begin, size);
+                begin += size;
+            }
+        } else {
+            if (rows > static_cast<size_t>(end - begin) / sizeof(value_t)) {
+                return false;
+            }
+            size_t size = values.size();
+            values.resize(size + rows);
+            std::memcpy(values.data() + size, begin, rows * sizeof(value_t));
+            begin += rows * sizeof(value_t);
+        }
+        return true;
+    }, data);
+}
+
+bool decodeBinary(StringPool& keys, size_t rows, const char*& begin,
+                  const char* end) {
+    for (size_t i = 0; i < rows; ++i) {
+        uint64_t size{0};
+        if (!decodeVarint(size, begin, end) ||
+                size > static_cast<uint64_t>(end - begin)) {
+            return false;
+        }
+        keys.push_back({begin, size});
+        begin += size;
+    }
+    return true;
+}
+
+void encodeBinary(const column_data_t& data, size_t row, std::string& to) {
+    std::visit([&] (const auto& values) {
+        typedef typename std::decay_t<decltype(values)>::value_type value_t;
+        if constexpr (g_is_string<value_t>) {
+            encodeVarint(values[row].size(), to);
+            to.append(values[row]);
+        } else {
+            to.append(reinterpret_cast<const char*>(&values[row]),
+                      sizeof(value_t));
+        }
+    }, data);
+}
+
+void appendColumn(column_data_t& to, column_data_t&& from) {
+    std::visit([&from] (auto& values) {
+        auto& from_values = std::get<std::decay_t<decltype(values)>>(from);
+        values.insert(values.end(),
+                      std::make_move_iterator(from_values.begin()),
+                      std::make_move_iterator(from_values.end()));
+    }, to);
+}
+
+bool appendColumn(column_data_t& to, const ch::ColumnRef& from) {
+    return std::visit([&from] (auto& values) {
+        typedef typename std::decay_t<decltype(values)>::value_type value_t;
+        if constexpr (g_is_string<value_t>) {
+            auto strings = from->As<ch::ColumnString>();
+            if (!strings) {
+                return false;
+            }
+            values.reserve(values.size() + strings->Size());
+            for (size_t i = 0; i < strings->Size(); ++i) {
+                values.emplace_back(strings->At(i));
+            }
+        } else if constexpr (std::is_same_v<value_t, date_t>) {
+            auto dates = from->As<ch::ColumnDate>();
+            if (!dates) {
+                return false;
+            }
+            values.reserve(values.size() + dates->Size());
+            for (size_t i = 0; i < dates->Size(); ++i) {
+                values.push_back({static_cast<uint16_t>(
+                    dates->At(i) / g_seconds_per_day)});
+            }
+        } else if constexpr (std::is_same_v<value_t, date_time_t>) {
+            auto times = from->As<ch::ColumnDateTime>();
+            if (!times) {
+                return false;
+            }
+            values.reserve(values.size() + times->Size());
+            for (size_t i = 0; i < times->Size(); ++i) {
+                values.push_back({static_cast<uint32_t>(times->At(i))});
+            }
+        } else {
+            auto numbers = from->As<ch::ColumnVector<value_t>>();
+            if (!numbers) {
+                return false;
+            }
+            values.reserve(values.size() + numbers->Size());
+            for (size_t i = 0; i < numbers->Size(); ++i) {
+                values.push_back(numbers->At(i));
+            }
+        }
+        return true;
+    }, to);
+}
+
+ch::ColumnRef makeColumn(const column_data_t& data, size_t begin, size_t end) {
+    return std::visit([begin, end] (const auto& values) -> ch::ColumnRef {
+        typedef typename std::decay_t<decltype(values)>::value_type value_t;
+        if constexpr (g_is_string<value_t>) {
+            auto column = std::make_shared<ch::ColumnString>();
+            column->Reserve(end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                column->Append(values[i]);
+            }
+            return column;
+        } else if constexpr (std::is_same_v<value_t, date_t>) {
+            auto column = std::make_shared<ch::ColumnDate>();
+            column->Reserve(end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                column->Append(static_cast<std::time_t>(values[i].days) *
+                               g_seconds_per_day);
+            }
+            return column;
+        } else if constexpr (std::is_same_v<value_t, date_time_t>) {
+            auto column = std::make_shared<ch::ColumnDateTime>();
+            column->Reserve(end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                column->Append(static_cast<std::time_t>(values[i].seconds));
+            }
+            return column;
+        } else {
+            return std::make_shared<ch::ColumnVector<value_t>>(
+                std::vector<value_t>(values.begin() + begin,
+                                     values.begin() + end));
+        }
+    }, data);
+}
+
+void appendChunk(rows_t& to, rows_t&& from) {
+    for (auto& reject: from.rejects) {
+        reject.line += to.lines;
+        to.rejects.push_back(std::move(reject));
+    }
+    to.lines += from.lines;
+    to.keys.Append(from.keys);
+    to.integer_keys.insert(to.integer_keys.end(), from.integer_keys.begin(),
+                           from.integer_keys.end());
+    for (size_t i = 0; i < to.columns.size(); ++i) {
+        appendColumn(to.columns[i].data, std::move(from.columns[i].data));
+    }
+}
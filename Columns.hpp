@@ -0,0 +1,140 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+#include <clickhouse/client.h>
+
+#include "StringPool.hpp"
+
+///> a value of a Date column: days since 1970-01-01
+struct date_t {
+    uint16_t days;
+};
+///> a value of a DateTime column: seconds since the epoch, in UTC
+struct date_time_t {
+    uint32_t seconds;
+};
+
+///> values of one column in the type of the table column
+typedef std::variant<
+    std::vector<uint8_t>, std::vector<uint16_t>,
+    std::vector<uint32_t>, std::vector<uint64_t>,
+    std::vector<int8_t>, std::vector<int16_t>,
+    std::vector<int32_t>, std::vector<int64_t>,
+    std::vector<float>, std::vector<double>,
+    std::vector<std::string>,
+    std::vector<date_t>, std::vector<date_time_t>
+> column_data_t;
+
+struct column_t {
+    std::string name;
+    column_data_t data;
+};
+typedef std::vector<column_t> columns_t;
+
+///> a record which didn't pass validation
+struct reject_t {
+    size_t line;            ///> where the record starts, from 1
+    std::string record;
+    std::string reason;
+};
+
+/*!
+ * @brief rows read from a file: the keys the table is deduplicated by
+ *  and the other columns of the scheme found in the file, if any
+ */
+struct rows_t {
+    StringPool keys;
+    ///> keys of a UInt64 key column as numbers, parsed once; else empty
+    std::vector<uint64_t> integer_keys;
+    columns_t columns;
+    std::vector<reject_t> rejects;
+    ///> lines of the input the rows were read from
+    size_t lines{0};
+
+    size_t size() const { return keys.size(); }
+    ///> key_bytes of all keys, unknown if 0
+    void reserve(size_t rows, size_t key_bytes = 0);
+    void clear();
+    ///> drops the rows from the given one on, e.g. a half parsed one
+    void Truncate(size_t rows);
+    ///> drops the given rows, in ascending order
+    void Erase(const std::vector<size_t>& rows);
+    ///> the same columns, empty
+    rows_t Like() const;
+    bool SameColumns(const rows_t& other) const;
+    ///> moves rows of from to the end, without their keys
+    void MoveColumns(rows_t& from, const std::vector<size_t>& rows);
+    ///> bytes of row on the wire, without its key
+    size_t ColumnBytes(size_t row) const;
+    ///> bytes of row on the wire with its UInt64 id and its key, which
+    ///> blocks and the insert buffer are both limited by
+    size_t RowBytes(size_t row) const;
+};
+
+/*!
+ * @brief empty values for a ClickHouse type
+ * @throw std::invalid_argument if the type isn't a number, String,
+ *  Date or DateTime
+ */
+column_data_t makeColumnData(std::string_view type);
+
+/*!
+ * @brief parses field and appends it
+ * @return false if field isn't a value of the column type
+ * @details a Date is YYYY-MM-DD, a DateTime YYYY-MM-DD hh:mm:ss in UTC
+ *  or a unix timestamp
+ */
+bool appendField(column_data_t& data, std::string_view field);
+
+/*!
+ * @brief reads a LEB128 varint of the ClickHouse binary formats
+ * @param [in,out] begin moved past the varint
+ * @return false if the input ends first
+ */
+bool decodeVarint(uint64_t& value, const char*& begin, const char* end);
+
+///> appends value as a LEB128 varint, see decodeVarint
+void encodeVarint(uint64_t value, std::string& to);
+
+///> value as a ClickHouse string literal, quotes and backslashes escaped
+std::string quote(std::string_view value);
+
+/*!
+ * @brief appends rows values encoded as in the Native and RowBinary
+ *  formats: little endian numbers, a string as a varint size and bytes
+ * @param [in,out] begin moved past the values
+ * @return false if the input ends first
+ * @details numbers are copied with one memcpy
+ */
+bool decodeBinary(column_data_t& data, size_t rows, const char*& begin,
+                  const char* end);
+///> decodeBinary of String keys
+bool decodeBinary(StringPool& keys, size_t rows, const char*& begin,
+                  const char* end);
+
+///> appends the value of row encoded as decodeBinary decodes it
+void encodeBinary(const column_data_t& data, size_t row, std::string& to);
+
+/*!
+ * @brief appends rows of from to the end of to
+ * @warning from has to be of the same type
+ */
+void appendColumn(column_data_t& to, column_data_t&& from);
+
+/*!
+ * @brief appends the values of a column selected from the server
+ * @return false if from isn't of the type of to
+ */
+bool appendColumn(column_data_t& to, const clickhouse::ColumnRef& from);
+
+clickhouse::ColumnRef makeColumn(const column_data_t& data,
+                                 size_t begin, size_t end);
+
+/*!
+ * @brief appends rows of from to the end of to, for parseChunks
+ * @details line numbers of from's rejects go on from to's lines
+ */
+void appendChunk(rows_t& to, rows_t&& from);
@@ -0,0 +1,310 @@
+#include "CsvReader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+///> smaller inputs aren't worth a thread
+constexpr size_t g_min_chunk_bytes{1 << 20};
+///> start of a chunk its lines are estimated by
+constexpr size_t g_sample_bytes{64 * 1024};
+}
+
+CsvReader::CsvReader(size_t threads,
+                     const std::optional<csv_options_t>& options,
+                     const scheme_t& columns, validators_t validators):
+    threads_{std::max<size_t>(threads, 1)}, options_{options},
+    columns_{columns}, validators_{std::move(validators)}
+{
+    if (options_ && columns_.empty()) {
+        throw std::invalid_argument("csv columns need a key column");
+    }
+}
+
+/*!
+ * @brief reads the whole stream and parses it
+ * @throw std::invalid_argument if the header has no key column
+ */
+rows_t CsvReader::Read(std::istream& input) const {
+    return Parse(readAll(input));
+}
+
+/*!
+ * @brief parses chunks of whole records in parallel
+ * @throw std::invalid_argument if the header has no key column
+ * @details the header is counted as the first line
+ */
+rows_t CsvReader::Parse(std::string_view text) const {
+    layout_t layout;
+    size_t header_lines{0};
+    if (HasHeader()) {
+        const char* begin = text.data();
+        std::string scratch;
+        for (bool last = false; !last && begin != text.data() + text.size();) {
+            NextField(begin, text.data() + text.size(), scratch, last);
+        }
+        layout = Layout(text.substr(0, begin - text.data()));
+        header_lines = std::count(text.data(), begin, '\n');
+        text.remove_prefix(begin - text.data());
+    } else {
+        layout = Layout();
+    }
+    auto chunks = options_ ?
+        splitRecords(text, threads_, g_min_chunk_bytes,
+                     options_->quote, options_->escape) :
+        splitLines(text, threads_, g_min_chunk_bytes);
+    rows_t rows = parseChunks(chunks, [this, &layout] (std::string_view chunk) {
+        rows_t rows = layout.rows;
+        // without columns every line is a key
+        rows.reserve(estimateLines(chunk.substr(0, g_sample_bytes),
+                                   chunk.size()),
+                     options_ ? 0 : chunk.size());
+        ParseRecords(chunk, layout, rows);
+        return rows;
+    });
+    rows.lines += header_lines;
+    for (auto& reject: rows.rejects) {
+        reject.line += header_lines;
+    }
+    return rows;
+}
+
+bool CsvReader::HasHeader() const {
+    return options_ && options_->header;
+}
+
+/*!
+ * @brief maps fields of records onto the key and the other columns
+ * @param header the header record; without it the fields are the
+ *  columns in their order
+ * @throw std::invalid_argument if the header has no key column or a
+ *  mapped column is of an unsupported type
+ * @details header fields which aren't columns are skipped
+ */
+CsvReader::layout_t CsvReader::Layout(
+        std::optional<std::string_view> header) const {
+    layout_t layout;
+    if (!options_ || !header) {
+        size_t columns = options_ ? columns_.size() : 1;
+        for (size_t i = 0; i < columns; ++i) {
+            if (i) {
+                layout.rows.columns.push_back(
+                    {columns_[i].first, makeColumnData(columns_[i].second)});
+            }
+            layout.fields.push_back(i);
+            layout.checks.push_back(Validator(i));
+        }
+        return layout;
+    }
+    const char* begin = header->data();
+    const char* end = begin + header->size();
+    std::string scratch;
+    bool has_key{false};
+    for (bool last = false; !last && begin != end;) {
+        std::string_view name = NextField(begin, end, scratch, last);
+        size_t column{0};
+        while (column < columns_.size() && columns_[column].first != name) {
+            ++column;
+        }
+        layout.checks.push_back(
+            column == columns_.size() ? nullptr : Validator(column));
+        if (column == columns_.size()) {
+            layout.fields.push_back(-1);
+        } else if (column == 0) {
+            layout.fields.push_back(0);
+            has_key = true;
+        } else {
+            layout.rows.columns.push_back(
+                {columns_[column].first,
+                 makeColumnData(columns_[column].second)});
+            layout.fields.push_back(layout.rows.columns.size());
+        }
+    }
+    if (!has_key) {
+        throw std::invalid_argument("no " + columns_[0].first +
+                                    " column in the csv header");
+    }
+    return layout;
+}
+
+/*!
+ * @details line numbers of rejects go on from rows.lines
+ */
+void CsvReader::ParseRecord(std::string_view line, const layout_t& layout,
+                            rows_t& rows) const {
+    ParseRecords(line, layout, rows);
+}
+
+/*!
+ * @brief parses every record of text into rows
+ * @details a record which is malformed or fails a validator is
+ *  dropped from the rows and added to their rejects; a record with a
+ *  broken quote is rejected up to the end of its line
+ */
+void CsvReader::ParseRecords(std::string_view text, const layout_t& layout,
+                             rows_t& rows) const {
+    if (!options_) {
+        forEachLine(text, [&] (std::string_view line) {
+            ++rows.lines;
+            const char* reason = layout.checks[0] ?
+                layout.checks[0]->Check(line) : nullptr;
+            if (reason) {
+                rows.rejects.push_back({rows.lines, std::string(line),
+                                        reason});
+            } else {
+                rows.keys.push_back(line);
+            }
+        });
+        return;
+    }
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    std::string scratch;
+    while (begin != end) {
+        if (*begin == '\n') {
+            ++begin;
+            ++rows.lines;
+            continue;
+        }
+        if (*begin == '\r' && begin + 1 != end && begin[1] == '\n') {
+            begin += 2;
+            ++rows.lines;
+            continue;
+        }
+        const char* record = begin;
+        size_t row = rows.size();
+        std::string reason;
+        try {
+            size_t field{0};
+            for (bool last = false; !last; ++field) {
+                std::string_view value = NextField(begin, end, scratch, last);
+                if (!reason.empty() || field >= layout.fields.size()) {
+                    continue;
+                }
+                const char* broken = layout.checks[field] ?
+                    layout.checks[field]->Check(value) : nullptr;
+                if (broken) {
+                    reason = broken;
+                    continue;
+                }
+                int target = layout.fields[field];
+                if (target == 0) {
+                    rows.keys.push_back(value);
+                } else if (target > 0 &&
+                           !appendField(rows.columns[target - 1].data,
+                                        value)) {
+                    reason = "not of the column type";
+                }
+            }
+            if (reason.empty() && field != layout.fields.size()) {
+                reason = field < layout.fields.size() ?
+                    "too few fields" : "too many fields";
+            }
+        } catch (const std::runtime_error& e) {
+            reason = e.what();
+            auto newline = static_cast<const char*>(
+                std::memchr(begin, '\n', end - begin));
+            begin = newline ? newline + 1 : end;
+        }
+        size_t line = rows.lines + 1;
+        rows.lines += std::count(record, begin, '\n');
+        if (reason.empty()) {
+            continue;
+        }
+        rows.Truncate(row);
+        std::string_view rejected(record, begin - record);
+        while (!rejected.empty() &&
+               (rejected.back() == '\n' || rejected.back() == '\r')) {
+            rejected.remove_suffix(1);
+        }
+        rows.rejects.push_back({line, std::string(rejected),
+                                std::move(reason)});
+    }
+}
+
+/*!
+ * @brief validator of the column-th column, nullptr if it has none
+ */
+const ColumnValidator* CsvReader::Validator(size_t column) const {
+    if (column >= columns_.size()) {
+        return nullptr;
+    }
+    auto found = validators_.find(columns_[column].first);
+    return found == validators_.end() ? nullptr : &found->second;
+}
+
+/*!
+ * @brief takes the field at begin and moves begin past its delimiter
+ * @param scratch holds the field if it has escaped characters,
+ *  otherwise the field points into the text
+ * @param [out] last whether the field ended its record
+ * @throw std::runtime_error on an unterminated quoted field or
+ *  characters after its closing quote
+ */
+std::string_view CsvReader::NextField(const char*& begin, const char* end,
+                                      std::string& scratch, bool& last) const {
+    const char quote{options_->quote};
+    const char escape{options_->escape};
+    const char delimiter{options_->delimiter};
+    const char* p = begin;
+    std::string_view value;
+    if (p != end && *p == quote) {
+        const char* start = ++p;
+        bool copied{false};
+        for (;;) {
+            if (p == end) {
+                throw std::runtime_error("unterminated quoted csv field");
+            }
+            bool escaped = escape == quote ?
+                *p == quote && p + 1 != end && p[1] == quote :
+                *p == escape && p + 1 != end;
+            if (escaped) {
+                if (!copied) {
+                    scratch.assign(start, p);
+                    copied = true;
+                }
+                scratch.push_back(p[1]);
+                p += 2;
+                continue;
+            }
+            if (*p == quote) {
+                break;
+            }
+            if (copied) {
+                scratch.push_back(*p);
+            }
+            ++p;
+        }
+        value = copied ? std::string_view(scratch) :
+            std::string_view(start, p - start);
+        ++p;
+    } else {
+        const char* start = p;
+        while (p != end && *p != delimiter && *p != '\n') {
+            ++p;
+        }
+        value = std::string_view(start, p - start);
+        if (!value.empty() && value.back() == '\r' &&
+                (p == end || *p == '\n')) {
+            value.remove_suffix(1);
+        }
+    }
+    if (p == end) {
+        last = true;
+    } else if (*p == delimiter) {
+        ++p;
+        last = false;
+    } else if (*p == '\n') {
+        ++p;
+        last = true;
+    } else if (*p == '\r' && p + 1 != end && p[1] == '\n') {
+        p += 2;
+        last = true;
+    } else {
+        throw std::runtime_error("unexpected character after a quoted "
+                                 "csv field");
+    }
+    begin = p;
+    return value;
+}
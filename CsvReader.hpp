@@ -0,0 +1,73 @@
+#pragma once
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ColumnValidator.hpp"
+#include "Columns.hpp"
+#include "LineChunks.hpp"
+
+///> dialect of a delimited file; TSV is a delimiter of '\t'
+struct csv_options_t {
+    char delimiter{','};
+    char quote{'"'};
+    ///> makes the next character literal in quotes; the quote itself
+    ///> means a doubled quote, as in RFC 4180
+    char escape{'"'};
+    bool header{false};
+};
+
+/*!
+ * @brief reads a file of one key per line or, given csv options, an
+ *  RFC 4180 file whose columns are mapped onto table columns
+ * @details a file is split into chunks of whole records parsed and
+ *  validated on threads of their own, the rows keep the order of the
+ *  file. Numbers are parsed by std::from_chars right from the file's
+ *  bytes into vectors of the column type. Records which are malformed
+ *  or fail a validator become rejects of the rows instead.
+ */
+class CsvReader final {
+public:
+    typedef std::vector<std::pair<std::string, std::string>> scheme_t;
+    ///> where the fields of a record go
+    struct layout_t {
+        ///> per field: the key (0), a column of rows (i + 1) or none (-1)
+        std::vector<int> fields;
+        ///> per field: its column's validator, if any
+        std::vector<const ColumnValidator*> checks;
+        ///> rows of the mapped columns, empty
+        rows_t rows;
+    };
+
+    /*!
+     * @param options dialect, std::nullopt for a key per line
+     * @param columns name and type of the key column, then the other
+     *  columns a file may fill
+     * @param validators checks of the columns by name
+     */
+    CsvReader(size_t threads, const std::optional<csv_options_t>& options,
+              const scheme_t& columns, validators_t validators = {});
+
+    rows_t Read(std::istream& input) const;
+    rows_t Parse(std::string_view text) const;
+    bool HasHeader() const;
+    ///> columns by name for a header line, by position otherwise
+    layout_t Layout(std::optional<std::string_view> header = {}) const;
+    ///> parses one record of a line by line input, a blank one is skipped
+    void ParseRecord(std::string_view line, const layout_t& layout,
+                     rows_t& rows) const;
+private:
+    std::string_view NextField(const char*& begin, const char* end,
+                               std::string& scratch, bool& last) const;
+    void ParseRecords(std::string_view text, const layout_t& layout,
+                      rows_t& rows) const;
+    const ColumnValidator* Validator(size_t column) const;
+
+    size_t threads_;
+    std::optional<csv_options_t> options_;
+    scheme_t columns_;
+    validators_t validators_;
+};
@@ -0,0 +1,189 @@
+#include "FileFollower.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr size_t g_read_size{1 << 20};
+
+std::runtime_error systemError(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+}
+
+/*!
+ * @param path file to follow, must exist
+ * @param offset_file file keeping the offset between runs
+ * @throw std::runtime_error if the file or inotify can't be opened
+ */
+FileFollower::FileFollower(const std::string& path,
+                           const std::string& offset_file):
+    path_{path}, offset_file_{offset_file}
+{
+    Open();
+    std::ifstream stored(offset_file_);
+    ino_t stored_inode{0};
+    uint64_t stored_offset{0};
+    struct stat info{};
+    if (stored >> stored_inode >> stored_offset &&
+            stored_inode == inode_ &&
+            ::fstat(fd_, &info) == 0 &&
+            stored_offset <= static_cast<uint64_t>(info.st_size)) {
+        offset_ = stored_offset;
+    }
+
+    inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        throw systemError("can't init inotify");
+    }
+    // the directory reports appends to the file as well as its rotation
+    std::string directory{
+        std::filesystem::path(path_).parent_path().string()
+    };
+    if (::inotify_add_watch(inotify_fd_,
+            directory.empty() ? "." : directory.c_str(),
+            IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE) < 0) {
+        ::close(inotify_fd_);
+        ::close(fd_);
+        throw systemError("can't watch " + path_);
+    }
+}
+
+FileFollower::~FileFollower() {
+    ::close(inotify_fd_);
+    ::close(fd_);
+}
+
+/*!
+ * @brief opens path_ from its beginning
+ */
+void FileFollower::Open() {
+    int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw systemError("can't open file " + path_);
+    }
+    struct stat info{};
+    ::fstat(fd, &info);
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = fd;
+    inode_ = info.st_ino;
+    offset_ = 0;
+    pending_.clear();
+}
+
+/*!
+ * @return true if path_ now names another file than the open one
+ */
+bool FileFollower::Rotated() const {
+    struct stat info{};
+    return ::stat(path_.c_str(), &info) == 0 && info.st_ino != inode_;
+}
+
+/*!
+ * @brief reads up to max_lines appended lines
+ * @param [out] lines gets the lines without '\n'
+ * @param timeout how long to wait for appends if there are none
+ * @return a number of read lines, 0 on timeout
+ * @details a line is returned only when its '\n' is written, except
+ *  for the last line of a rotated file
+ */
+size_t FileFollower::Read(std::vector<std::string>& lines, size_t max_lines,
+                          std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    size_t read = ReadLines(lines, max_lines);
+    while (!read && std::chrono::steady_clock::now() < deadline) {
+        Wait(std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()));
+        read = ReadLines(lines, max_lines);
+    }
+    return read;
+}
+
+size_t FileFollower::ReadLines(std::vector<std::string>& lines,
+                               size_t max_lines) {
+    struct stat info{};
+    if (::fstat(fd_, &info) == 0 &&
+            static_cast<uint64_t>(info.st_size) < offset_ + pending_.size()) {
+        offset_ = 0;  // truncated
+        pending_.clear();
+    }
+    size_t read{0}, begin{0}, scanned{0};
+    std::string buffer(g_read_size, '\0');
+    while (read < max_lines) {
+        size_t end = pending_.find('\n', scanned);
+        if (end != std::string::npos) {
+            lines.push_back(pending_.substr(begin, end - begin));
+            ++read;
+            begin = scanned = end + 1;
+            continue;
+        }
+        scanned = pending_.size();
+        ssize_t size = ::pread(fd_, buffer.data(), buffer.size(),
+                               offset_ + pending_.size());
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw systemError("can't read " + path_);
+        }
+        if (size > 0) {
+            pending_.append(buffer.data(), size);
+            continue;
+        }
+        if (!Rotated()) {
+            break;
+        }
+        if (begin < pending_.size()) {
+            lines.push_back(pending_.substr(begin));
+            ++read;
+        }
+        Open();
+        begin = scanned = 0;
+    }
+    pending_.erase(0, begin);
+    offset_ += begin;
+    return read;
+}
+
+/*!
+ * @brief waits for changes in the file's directory
+ * @details may return early on an interrupting signal
+ */
+void FileFollower::Wait(std::chrono::milliseconds timeout) {
+    pollfd watched{inotify_fd_, POLLIN, 0};
+    if (::poll(&watched, 1, static_cast<int>(timeout.count())) > 0) {
+        alignas(inotify_event) char events[4096];
+        while (::read(inotify_fd_, events, sizeof(events)) > 0) {
+        }
+    }
+}
+
+/*!
+ * @brief persists the offset of the lines returned so far
+ * @throw std::runtime_error if the offset file can't be written
+ * @details call it once the returned lines are stored
+ */
+void FileFollower::Commit() {
+    std::string tmp{offset_file_ + ".tmp"};
+    {
+        std::ofstream stored(tmp, std::ios::trunc);
+        stored << inode_ << ' ' << offset_ << std::endl;
+        if (!stored) {
+            throw std::runtime_error("can't write " + tmp);
+        }
+    }
+    if (std::rename(tmp.c_str(), offset_file_.c_str()) != 0) {
+        throw systemError("can't replace " + offset_file_);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/*!
+ * @brief reads lines appended to a growing file, like tail -F
+ * @details waits for appends with inotify, starts over when the file
+ *  is truncated and follows it when it is rotated (renamed or deleted
+ *  and created again). The offset of the lines returned so far is
+ *  persisted by Commit and picked up again by the next follower of the
+ *  same file unless the file was rotated meanwhile.
+ */
+class FileFollower final {
+public:
+    FileFollower(const std::string& path, const std::string& offset_file);
+    FileFollower(const FileFollower&) = delete;
+    FileFollower& operator=(const FileFollower&) = delete;
+    ~FileFollower();
+
+    size_t Read(std::vector<std::string>& lines, size_t max_lines,
+                std::chrono::milliseconds timeout);
+    void Commit();
+    uint64_t Offset() const { return offset_; }
+    const std::string& Path() const { return path_; }
+private:
+    size_t ReadLines(std::vector<std::string>& lines, size_t max_lines);
+    bool Rotated() const;
+    void Open();
+    void Wait(std::chrono::milliseconds timeout);
+
+    std::string path_;
+    std::string offset_file_;
+    int fd_{-1};
+    int inotify_fd_{-1};
+    ino_t inode_{0};
+    uint64_t offset_{0};    ///> offset of the first byte not returned
+    std::string pending_;   ///> bytes read after offset_, no whole line
+};
@@ -0,0 +1,215 @@
+#include "FileManifest.hpp"
+#include "Columns.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include <cityhash/city.h>
+#include <fmt/format.h>
+#include <fmt/compile.h>
+
+namespace ch = clickhouse;
+
+namespace {
+constexpr size_t g_hash_chunk{1 << 20};
+}
+
+/*!
+ * @brief checks whether the file's contents were loaded already
+ * @throw std::runtime_error if the file can't be read
+ * @details a file recognized by its hash only is recorded under its
+ *  current path and mtime, the next check is a stat() again
+ */
+bool FileManifest::Ingested(const std::string& path) {
+    EnsureLoaded();
+    entry_t quick = Fingerprint(path, false);
+    auto known = by_path_.find(quick.path);
+    if (known != by_path_.end() && known->second.size == quick.size &&
+            known->second.mtime_ns == quick.mtime_ns) {
+        return true;
+    }
+    entry_t full = Fingerprint(path, true);
+    if (hashes_.find(full.hash) != hashes_.end()) {
+        Store({full});
+        Remember(full);
+        return true;
+    }
+    checked_[full.path] = full;
+    return false;
+}
+
+/*!
+ * @brief stores fingerprints of the loaded files
+ * @details fingerprints taken by Ingested are reused, so a file
+ *  changed while it was loaded is checked again next time
+ */
+void FileManifest::Record(const std::vector<std::string>& paths) {
+    EnsureLoaded();
+    std::vector<entry_t> entries;
+    for (const auto& path: paths) {
+        entry_t quick = Fingerprint(path, false);
+        auto checked = checked_.find(quick.path);
+        entries.push_back(checked != checked_.end() ?
+            checked->second : Fingerprint(path, true));
+    }
+    if (entries.empty()) {
+        return;
+    }
+    Store(entries);
+    for (const auto& entry: entries) {
+        Remember(entry);
+        checked_.erase(entry.path);
+    }
+}
+
+void FileManifest::EnsureLoaded() {
+    if (loaded_) {
+        return;
+    }
+    for (const auto& entry: LoadEntries()) {
+        Remember(entry);
+    }
+    loaded_ = true;
+}
+
+void FileManifest::Remember(const FileManifest::entry_t& entry) {
+    by_path_[entry.path] = entry;
+    hashes_.insert(entry.hash);
+}
+
+/*!
+ * @brief stats and optionally hashes a file
+ * @details the hash is CityHash64 chained over 1MB chunks and seeded
+ *  with the size
+ */
+FileManifest::entry_t FileManifest::Fingerprint(const std::string& path,
+                                                bool with_hash) {
+    namespace fs = std::filesystem;
+    struct stat info{};
+    if (::stat(path.c_str(), &info) != 0) {
+        throw std::runtime_error("can't stat file " + path);
+    }
+    entry_t entry{
+        fs::absolute(path).lexically_normal().string(),
+        static_cast<uint64_t>(info.st_size),
+        static_cast<int64_t>(info.st_mtim.tv_sec) * 1'000'000'000 +
+            info.st_mtim.tv_nsec,
+        static_cast<uint64_t>(info.st_size)
+    };
+    if (!with_hash) {
+        return entry;
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("can't open file " + path);
+    }
+    std::string chunk(g_hash_chunk, '\0');
+    while (file.read(chunk.data(), chunk.size()) || file.gcount()) {
+        entry.hash = CityHash64WithSeed(chunk.data(), file.gcount(),
+                                        entry.hash);
+    }
+    return entry;
+}
+
+/*!
+ * @param manifest_file file of "hash size mtime_ns path" lines
+ */
+LocalFileManifest::LocalFileManifest(std::string_view manifest_file):
+    manifest_file_{manifest_file}
+{}
+
+std::vector<FileManifest::entry_t> LocalFileManifest::LoadEntries() {
+    std::vector<entry_t> entries;
+    std::ifstream file(manifest_file_);
+    for (std::string line; std::getline(file, line);) {
+        std::istringstream fields(line);
+        entry_t entry;
+        if (fields >> entry.hash >> entry.size >> entry.mtime_ns &&
+                fields.get() == '\t' && std::getline(fields, entry.path)) {
+            entries.push_back(std::move(entry));
+        }
+    }
+    return entries;
+}
+
+/*!
+ * @throw std::runtime_error if the manifest can't be appended
+ */
+void LocalFileManifest::Store(const std::vector<entry_t>& entries) {
+    std::ofstream file(manifest_file_, std::ios::app);
+    for (const auto& entry: entries) {
+        file << entry.hash << '\t' << entry.size << '\t'
+             << entry.mtime_ns << '\t' << entry.path << '\n';
+    }
+    file.flush();
+    if (!file) {
+        throw std::runtime_error("can't write manifest " + manifest_file_);
+    }
+}
+
+/*!
+ * @param client Clickhouse client
+ * @param db_name data base holding the ingested_files table
+ * @param table_name table whose files are tracked
+ */
+ClickhouseManifest::ClickhouseManifest(ch::Client& client,
+                                       std::string_view db_name,
+                                       std::string_view table_name):
+    client_(&client), db_name_{db_name}, table_name_{table_name}
+{
+    client_->Execute(fmt::format(
+        FMT_COMPILE("CREATE TABLE IF NOT EXISTS {}.ingested_files "
+                    "(table_name String, path String, size UInt64, "
+                    "mtime_ns Int64, hash UInt64) "
+                    "ENGINE = MergeTree ORDER BY (table_name, path)"),
+        db_name_)
+    );
+}
+
+std::vector<FileManifest::entry_t> ClickhouseManifest::LoadEntries() {
+    std::vector<entry_t> entries;
+    std::string query(fmt::format(
+        FMT_COMPILE("SELECT path, size, mtime_ns, hash "
+                    "FROM {}.ingested_files WHERE table_name = {}"),
+        db_name_, quote(table_name_))
+    );
+    client_->Select(query, [&] (const ch::Block& block) {
+        for (size_t i = 0; i < block.GetRowCount(); ++i) {
+            entries.push_back({
+                std::string{block[0]->As<ch::ColumnString>()->At(i)},
+                block[1]->As<ch::ColumnUInt64>()->At(i),
+                block[2]->As<ch::ColumnInt64>()->At(i),
+                block[3]->As<ch::ColumnUInt64>()->At(i)
+            });
+        }
+    });
+    return entries;
+}
+
+void ClickhouseManifest::Store(const std::vector<entry_t>& entries) {
+    auto table_names = std::make_shared<ch::ColumnString>();
+    auto paths = std::make_shared<ch::ColumnString>();
+    auto sizes = std::make_shared<ch::ColumnUInt64>();
+    auto mtimes = std::make_shared<ch::ColumnInt64>();
+    auto hashes = std::make_shared<ch::ColumnUInt64>();
+    for (const auto& entry: entries) {
+        table_names->Append(table_name_);
+        paths->Append(entry.path);
+        sizes->Append(entry.size);
+        mtimes->Append(entry.mtime_ns);
+        hashes->Append(entry.hash);
+    }
+    ch::Block block;
+    block.AppendColumn("table_name", table_names);
+    block.AppendColumn("path", paths);
+    block.AppendColumn("size", sizes);
+    block.AppendColumn("mtime_ns", mtimes);
+    block.AppendColumn("hash", hashes);
+    client_->Insert(
+        fmt::format(FMT_COMPILE("{}.ingested_files"), db_name_), block
+    );
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <clickhouse/client.h>
+
+/*!
+ * @brief fingerprints of files already loaded into a table
+ * @details a file is ingested if its path, size and mtime match an
+ *  entry, which takes a stat(); otherwise its contents are hashed and
+ *  compared, so a touched or renamed copy is recognized as well
+ */
+class FileManifest {
+public:
+    struct entry_t {
+        std::string path;
+        uint64_t size;
+        int64_t mtime_ns;
+        uint64_t hash;
+    };
+
+    virtual ~FileManifest() = default;
+
+    bool Ingested(const std::string& path);
+    void Record(const std::vector<std::string>& paths);
+protected:
+    ///> takes stored entries, called once before the first check
+    virtual std::vector<entry_t> LoadEntries() = 0;
+    virtual void Store(const std::vector<entry_t>& entries) = 0;
+private:
+    void EnsureLoaded();
+    void Remember(const entry_t& entry);
+    static entry_t Fingerprint(const std::string& path, bool with_hash);
+
+    bool loaded_{false};
+    std::unordered_map<std::string, entry_t> by_path_;
+    std::unordered_set<uint64_t> hashes_;
+    std::unordered_map<std::string, entry_t> checked_;
+};
+
+/*!
+ * @brief manifest kept in a local tab separated file
+ */
+class LocalFileManifest final : public FileManifest {
+public:
+    explicit LocalFileManifest(std::string_view manifest_file);
+protected:
+    std::vector<entry_t> LoadEntries() override;
+    void Store(const std::vector<entry_t>& entries) override;
+private:
+    std::string manifest_file_;
+};
+
+/*!
+ * @brief manifest kept in {db}.ingested_files, shared by all hosts
+ */
+class ClickhouseManifest final : public FileManifest {
+public:
+    ClickhouseManifest(clickhouse::Client& client,
+                       std::string_view db_name,
+                       std::string_view table_name);
+protected:
+    std::vector<entry_t> LoadEntries() override;
+    void Store(const std::vector<entry_t>& entries) override;
+private:
+    clickhouse::Client* client_;
+    std::string db_name_;
+    std::string table_name_;
+};
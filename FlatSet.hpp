@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+/*!
+ * @brief set of unsigned integers kept in an open addressing table of
+ *  the integers themselves
+ * @details a key takes sizeof(T) / 0.75 bytes at most and a lookup
+ *  touches one cache line mostly; 0 marks a free slot, so the key 0 is
+ *  kept aside
+ */
+template <typename T>
+class FlatSet final {
+    static_assert(std::is_unsigned_v<T>, "FlatSet keeps unsigned integers");
+public:
+    ///> @return false if the key is there already
+    bool insert(T key) {
+        if (!key) {
+            bool inserted = !has_zero_;
+            has_zero_ = true;
+            return inserted;
+        }
+        if ((size_ + 1) * g_max_load_den > slots_.size() * g_max_load_num) {
+            Rehash(std::max(slots_.size() * 2, g_min_slots));
+        }
+        T& slot = slots_[Find(key)];
+        if (slot) {
+            return false;
+        }
+        slot = key;
+        ++size_;
+        return true;
+    }
+    bool contains(T key) const {
+        if (!key) {
+            return has_zero_;
+        }
+        return !slots_.empty() && slots_[Find(key)];
+    }
+    size_t size() const { return size_ + has_zero_; }
+    void reserve(size_t keys, size_t = 0) {
+        size_t slots{g_min_slots};
+        while (keys * g_max_load_den > slots * g_max_load_num) {
+            slots *= 2;
+        }
+        if (slots > slots_.size()) {
+            Rehash(slots);
+        }
+    }
+    void clear() {
+        slots_.assign(slots_.size(), T{0});
+        size_ = 0;
+        has_zero_ = false;
+    }
+    ///> bytes the set holds
+    size_t Capacity() const { return slots_.capacity() * sizeof(T); }
+private:
+    static constexpr size_t g_min_slots{16};
+    ///> the table grows at 3/4 full
+    static constexpr size_t g_max_load_num{3}, g_max_load_den{4};
+
+    ///> Fibonacci hashing, ids coming in order spread over the table
+    size_t Home(T key) const {
+        return (static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> shift_;
+    }
+    ///> the slot of the key or the free one it would take
+    size_t Find(T key) const {
+        size_t mask = slots_.size() - 1;
+        for (size_t i = Home(key);; i = (i + 1) & mask) {
+            if (!slots_[i] || slots_[i] == key) {
+                return i;
+            }
+        }
+    }
+    ///> @param slots a power of 2
+    void Rehash(size_t slots) {
+        std::vector<T> old(slots, T{0});
+        old.swap(slots_);
+        shift_ = 64;
+        for (size_t size = slots; size > 1; size /= 2) {
+            --shift_;
+        }
+        for (T key: old) {
+            if (key) {
+                slots_[Find(key)] = key;
+            }
+        }
+    }
+
+    std::vector<T> slots_;
+    size_t size_{0};        ///> of the keys but 0
+    bool has_zero_{false};
+    unsigned shift_{64};    ///> 64 - log2 of slots_.size()
+};
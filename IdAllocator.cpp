@@ -0,0 +1,207 @@
+#include "IdAllocator.hpp"
+#include "Columns.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <fmt/compile.h>
+
+namespace ch = clickhouse;
+
+namespace {
+constexpr int g_max_lease_attempts{16};
+
+/// closes a file descriptor (and releases its flock) on scope exit
+struct fd_guard {
+    int fd;
+    ~fd_guard() { ::close(fd); }
+};
+}
+
+LeasedIdAllocator::LeasedIdAllocator(uint64_t lease_size):
+    lease_size_{std::max<uint64_t>(lease_size, 1)}
+{}
+
+/*!
+ * @brief appends count ids taken from the current lease
+ * @details takes a new lease when the current one is exhausted or
+ *  has fallen behind the table's max id
+ */
+void LeasedIdAllocator::Generate(size_t count, uint64_t current_max_id,
+                                 std::vector<uint64_t>& ids) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (current_.count && current_.first <= current_max_id) {
+        uint64_t stale = std::min(current_.count,
+                                  current_max_id - current_.first + 1);
+        current_.first += stale;
+        current_.count -= stale;
+    }
+    ids.reserve(ids.size() + count);
+    while (count) {
+        if (!current_.count) {
+            current_ = Lease(std::max<uint64_t>(count, lease_size_),
+                             current_max_id);
+        }
+        uint64_t taken = std::min<uint64_t>(count, current_.count);
+        for (uint64_t i = 0; i < taken; ++i) {
+            ids.push_back(current_.first + i);
+        }
+        current_.first += taken;
+        current_.count -= taken;
+        count -= taken;
+    }
+}
+
+/*!
+ * @param counter_file path to a file storing the next free id
+ * @param lease_size number of ids taken per lease
+ */
+FileIdAllocator::FileIdAllocator(std::string_view counter_file,
+                                 uint64_t lease_size):
+    LeasedIdAllocator(lease_size), counter_file_{counter_file}
+{}
+
+/*!
+ * @brief moves the counter in the file forward under an exclusive flock
+ * @throw std::runtime_error if the file can't be locked, read or written
+ */
+FileIdAllocator::lease_t FileIdAllocator::Lease(uint64_t count,
+                                                uint64_t floor) {
+    int fd = ::open(counter_file_.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("can't open id counter " + counter_file_);
+    }
+    fd_guard guard{fd};
+    if (::flock(fd, LOCK_EX) != 0) {
+        throw std::runtime_error("can't lock id counter " + counter_file_);
+    }
+    char buf[32] = {};
+    ssize_t read_bytes = ::pread(fd, buf, sizeof(buf) - 1, 0);
+    if (read_bytes < 0) {
+        throw std::runtime_error("can't read id counter " + counter_file_);
+    }
+    uint64_t next = std::strtoull(buf, nullptr, 10);
+    lease_t lease{std::max(next, floor + 1), count};
+
+    std::string stored{std::to_string(lease.first + lease.count)};
+    if (::ftruncate(fd, 0) != 0 ||
+            ::pwrite(fd, stored.data(), stored.size(), 0) !=
+                static_cast<ssize_t>(stored.size()) ||
+            ::fsync(fd) != 0) {
+        throw std::runtime_error("can't write id counter " + counter_file_);
+    }
+    return lease;
+}
+
+/*!
+ * @param client Clickhouse client
+ * @param db_name data base holding the id_leases table
+ * @param sequence name of the id sequence, usually the filled table's name
+ * @param lease_size number of ids taken per lease
+ */
+ClickhouseIdAllocator::ClickhouseIdAllocator(ch::Client& client,
+                                             std::string_view db_name,
+                                             std::string_view sequence,
+                                             uint64_t lease_size):
+    LeasedIdAllocator(lease_size),
+    client_(&client), db_name_{db_name}, sequence_{sequence}
+{
+    client_->Execute(fmt::format(
+        FMT_COMPILE("CREATE TABLE IF NOT EXISTS {}.id_leases "
+                    "(sequence String, first UInt64, count UInt64, "
+                    "owner String) "
+                    "ENGINE = MergeTree ORDER BY (sequence, first)"),
+        db_name_)
+    );
+}
+
+/*!
+ * @brief claims a range above every existing lease
+ * @throw std::runtime_error if no claim survives g_max_lease_attempts
+ * @details Clickhouse has no compare-and-swap, so a claim is inserted
+ *  optimistically and kept only if no overlapping claim of another owner
+ *  is visible right after the insert. Of two racing claims at least the
+ *  later inserted one sees the other and backs off; both may back off,
+ *  never both win. Abandoned claims only leave a gap in the sequence.
+ */
+ClickhouseIdAllocator::lease_t ClickhouseIdAllocator::Lease(uint64_t count,
+                                                            uint64_t floor) {
+    std::mt19937_64 rng{std::random_device{}()};
+    for (int attempt = 0; attempt < g_max_lease_attempts; ++attempt) {
+        lease_t lease{std::max(SelectNext(), floor + 1), count};
+        std::string owner{fmt::format(FMT_COMPILE("{:016x}"), rng())};
+
+        ch::Block block;
+        auto sequence_column = std::make_shared<ch::ColumnString>();
+        sequence_column->Append(sequence_);
+        auto first_column = std::make_shared<ch::ColumnUInt64>();
+        first_column->Append(lease.first);
+        auto count_column = std::make_shared<ch::ColumnUInt64>();
+        count_column->Append(lease.count);
+        auto owner_column = std::make_shared<ch::ColumnString>();
+        owner_column->Append(owner);
+        block.AppendColumn("sequence", sequence_column);
+        block.AppendColumn("first", first_column);
+        block.AppendColumn("count", count_column);
+        block.AppendColumn("owner", owner_column);
+        client_->Insert(
+            fmt::format(FMT_COMPILE("{}.id_leases"), db_name_), block
+        );
+
+        if (!HasConflicts(lease, owner)) {
+            return lease;
+        }
+        std::uniform_int_distribution<int> backoff_ms(
+            1, 1 << std::min(attempt, 10));
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(backoff_ms(rng)));
+    }
+    throw std::runtime_error("can't lease ids for " + sequence_);
+}
+
+/*!
+ * @return first id after every lease of the sequence
+ */
+uint64_t ClickhouseIdAllocator::SelectNext() {
+    uint64_t next{0};
+    std::string query(fmt::format(
+        FMT_COMPILE("SELECT max(first + count) FROM {}.id_leases "
+                    "WHERE sequence = {}"),
+        db_name_, quote(sequence_))
+    );
+    client_->Select(query, [&] (const ch::Block& block) {
+        if (block.GetRowCount()) {
+            next = block[0]->As<ch::ColumnUInt64>()->At(0);
+        }
+    });
+    return next;
+}
+
+/*!
+ * @return true if another owner claimed ids overlapping lease
+ */
+bool ClickhouseIdAllocator::HasConflicts(const lease_t& lease,
+                                         const std::string& owner) {
+    uint64_t conflicts{0};
+    std::string query(fmt::format(
+        FMT_COMPILE("SELECT count() FROM {}.id_leases "
+                    "WHERE sequence = {} AND first < {} "
+                    "AND first + count > {} AND owner != {}"),
+        db_name_, quote(sequence_), lease.first + lease.count, lease.first,
+        quote(owner))
+    );
+    client_->Select(query, [&] (const ch::Block& block) {
+        if (block.GetRowCount()) {
+            conflicts = block[0]->As<ch::ColumnUInt64>()->At(0);
+        }
+    });
+    return conflicts != 0;
+}
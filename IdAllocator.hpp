@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <clickhouse/client.h>
+
+/*!
+ * @brief a source of ids for rows pushed by ClickhouseFiller::Add
+ */
+class IdGenerator {
+public:
+    virtual ~IdGenerator() = default;
+    /*!
+     * @brief appends count new ids to ids
+     * @param current_max_id max id currently stored in the table
+     */
+    virtual void Generate(size_t count, uint64_t current_max_id,
+                          std::vector<uint64_t>& ids) = 0;
+};
+
+/*!
+ * @brief hands out ids from contiguous ranges leased from a shared counter
+ * @details a lease is taken only when the current one is exhausted,
+ *  so concurrent fillers coordinate once per lease_size ids
+ */
+class LeasedIdAllocator : public IdGenerator {
+public:
+    explicit LeasedIdAllocator(uint64_t lease_size);
+    void Generate(size_t count, uint64_t current_max_id,
+                  std::vector<uint64_t>& ids) override;
+protected:
+    struct lease_t {
+        uint64_t first;
+        uint64_t count;
+    };
+    ///> leases at least count ids starting above floor
+    virtual lease_t Lease(uint64_t count, uint64_t floor) = 0;
+private:
+    uint64_t lease_size_;
+    lease_t current_{0, 0};
+    std::mutex mutex_;
+};
+
+/*!
+ * @brief single host allocator keeping the counter in a flock()ed file
+ */
+class FileIdAllocator final : public LeasedIdAllocator {
+public:
+    FileIdAllocator(std::string_view counter_file, uint64_t lease_size);
+protected:
+    lease_t Lease(uint64_t count, uint64_t floor) override;
+private:
+    std::string counter_file_;
+};
+
+/*!
+ * @brief allocator keeping leases as rows of a Clickhouse table
+ * @details ids of every sequence are tracked in {db}.id_leases
+ */
+class ClickhouseIdAllocator final : public LeasedIdAllocator {
+public:
+    ClickhouseIdAllocator(clickhouse::Client& client,
+                          std::string_view db_name,
+                          std::string_view sequence,
+                          uint64_t lease_size);
+protected:
+    lease_t Lease(uint64_t count, uint64_t floor) override;
+private:
+    uint64_t SelectNext();
+    bool HasConflicts(const lease_t& lease, const std::string& owner);
+
+    clickhouse::Client* client_;
+    std::string db_name_;
+    std::string sequence_;
+};
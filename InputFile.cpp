@@ -0,0 +1,609 @@
+#include "InputFile.hpp"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lz4.h>
+#include <zlib.h>
+#include <zstd.h>
+
+namespace {
+constexpr size_t g_chunk_size{1 << 20};
+constexpr size_t g_max_queued_chunks{4};
+
+constexpr uint32_t g_lz4_frame_magic{0x184D2204};
+constexpr uint32_t g_lz4_skippable_magic{0x184D2A50};
+constexpr size_t g_lz4_window{64 * 1024};
+
+///> bytes of a zstd frame header at most, ZSTD_FRAMEHEADERSIZE_MAX
+constexpr size_t g_max_frame_header{18};
+///> bytes of an lz4 frame header up to the end of its content size
+constexpr size_t g_lz4_content_size_end{14};
+constexpr unsigned char g_lz4_content_size_flag{0x08};
+
+uint32_t readLe32(const unsigned char* bytes) {
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+           static_cast<uint32_t>(bytes[3]) << 24;
+}
+
+uint64_t readLe64(const unsigned char* bytes) {
+    return readLe32(bytes) | static_cast<uint64_t>(readLe32(bytes + 4)) << 32;
+}
+
+/*!
+ * @brief unbuffered by the OS stream buffer over a file descriptor
+ * @details works with pipes and FIFOs: a read returns whatever the
+ *  producer has written so far, and in_avail() tells whether more
+ *  data can be read without blocking
+ */
+class FdStreambuf final : public std::streambuf {
+public:
+    FdStreambuf(int fd, bool owned);
+    ~FdStreambuf() override;
+
+    std::string_view Peek(size_t size);
+protected:
+    int_type underflow() override;
+    std::streamsize showmanyc() override;
+    pos_type seekoff(off_type off, std::ios::seekdir dir,
+                     std::ios::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios::openmode which) override;
+private:
+    size_t ReadFd(char* dst, size_t size);
+
+    int fd_;
+    bool owned_;
+    std::vector<char> buffer_;
+};
+
+FdStreambuf::FdStreambuf(int fd, bool owned):
+    fd_{fd}, owned_{owned}, buffer_(g_chunk_size)
+{
+    setg(buffer_.data(), buffer_.data(), buffer_.data());
+}
+
+FdStreambuf::~FdStreambuf() {
+    if (owned_) {
+        ::close(fd_);
+    }
+}
+
+/*!
+ * @throw std::runtime_error on a read error
+ */
+size_t FdStreambuf::ReadFd(char* dst, size_t size) {
+    for (;;) {
+        ssize_t read = ::read(fd_, dst, size);
+        if (read >= 0) {
+            return static_cast<size_t>(read);
+        }
+        if (errno != EINTR) {
+            throw std::runtime_error(std::string("can't read input: ") +
+                                     std::strerror(errno));
+        }
+    }
+}
+
+/*!
+ * @brief returns at least size unread bytes without consuming them
+ * @details returns less only at the end of the input
+ */
+std::string_view FdStreambuf::Peek(size_t size) {
+    size_t unread = egptr() - gptr();
+    std::memmove(buffer_.data(), gptr(), unread);
+    setg(buffer_.data(), buffer_.data(), buffer_.data() + unread);
+    while (unread < size) {
+        size_t read = ReadFd(egptr(), buffer_.size() - unread);
+        if (!read) {
+            break;
+        }
+        unread += read;
+        setg(eback(), gptr(), egptr() + read);
+    }
+    return {gptr(), std::min(unread, size)};
+}
+
+FdStreambuf::int_type FdStreambuf::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    size_t read = ReadFd(buffer_.data(), buffer_.size());
+    setg(buffer_.data(), buffer_.data(), buffer_.data() + read);
+    return read ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+}
+
+/*!
+ * @brief seeks a regular file, fails for pipes
+ */
+FdStreambuf::pos_type FdStreambuf::seekpos(pos_type pos,
+                                           std::ios::openmode) {
+    if (::lseek(fd_, static_cast<off_t>(pos), SEEK_SET) < 0) {
+        return pos_type(off_type(-1));
+    }
+    setg(buffer_.data(), buffer_.data(), buffer_.data());
+    return pos;
+}
+
+/*!
+ * @brief seeks a regular file relative to the unread data, fails for
+ *  pipes
+ */
+FdStreambuf::pos_type FdStreambuf::seekoff(off_type off,
+                                           std::ios::seekdir dir,
+                                           std::ios::openmode which) {
+    if (dir == std::ios::beg) {
+        return seekpos(pos_type(off), which);
+    }
+    if (dir != std::ios::cur) {
+        return pos_type(off_type(-1));
+    }
+    off_t current = ::lseek(fd_, 0, SEEK_CUR);
+    if (current < 0) {
+        return pos_type(off_type(-1));
+    }
+    return seekpos(pos_type(current - (egptr() - gptr()) + off), which);
+}
+
+std::streamsize FdStreambuf::showmanyc() {
+    int available{0};
+    if (::ioctl(fd_, FIONREAD, &available) != 0) {
+        return 0;
+    }
+    return available;
+}
+
+/*!
+ * @brief stream buffer filled by a decoder thread via a bounded queue
+ */
+class DecompressingStreambuf final : public std::streambuf {
+public:
+    DecompressingStreambuf(std::unique_ptr<std::streambuf> source,
+                           compression_t compression);
+    ~DecompressingStreambuf() override;
+
+    std::string_view Peek(size_t size);
+protected:
+    int_type underflow() override;
+    std::streamsize showmanyc() override;
+private:
+    struct stopped_t {};
+
+    void Decode(compression_t compression);
+    void DecodeGzip();
+    void DecodeZstd();
+    void DecodeLz4();
+    void Emit(std::string&& chunk);
+    size_t Read(char* dst, size_t size);
+    bool ReadExactly(void* dst, size_t size, bool eof_allowed = false);
+
+    std::unique_ptr<std::streambuf> source_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<std::string> chunks_;
+    bool finished_{false};
+    bool stopped_{false};
+    std::exception_ptr error_;
+    std::string current_;
+    std::thread decoder_;
+};
+
+DecompressingStreambuf::DecompressingStreambuf(
+        std::unique_ptr<std::streambuf> source, compression_t compression):
+    source_{std::move(source)}
+{
+    decoder_ = std::thread([this, compression] { Decode(compression); });
+}
+
+DecompressingStreambuf::~DecompressingStreambuf() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    changed_.notify_all();
+    decoder_.join();
+}
+
+/*!
+ * @brief takes the next decoded chunk
+ * @throw std::runtime_error if the decoder failed
+ */
+DecompressingStreambuf::int_type DecompressingStreambuf::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return finished_ || !chunks_.empty(); });
+    if (chunks_.empty()) {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        return traits_type::eof();
+    }
+    current_ = std::move(chunks_.front());
+    chunks_.pop_front();
+    lock.unlock();
+    changed_.notify_all();
+    setg(current_.data(), current_.data(), current_.data() + current_.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+/*!
+ * @brief returns unread bytes without consuming them
+ * @details at most the rest of the current decoded chunk
+ */
+std::string_view DecompressingStreambuf::Peek(size_t size) {
+    if (gptr() == egptr()) {
+        underflow();
+    }
+    return {gptr(), std::min<size_t>(size, egptr() - gptr())};
+}
+
+std::streamsize DecompressingStreambuf::showmanyc() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunks_.empty() ? 0 : chunks_.front().size();
+}
+
+void DecompressingStreambuf::Decode(compression_t compression) {
+    try {
+        switch (compression) {
+        case compression_t::gzip:
+            DecodeGzip();
+            break;
+        case compression_t::zstd:
+            DecodeZstd();
+            break;
+        case compression_t::lz4:
+            DecodeLz4();
+            break;
+        case compression_t::none:
+            break;
+        }
+    } catch (const stopped_t&) {
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+    }
+    changed_.notify_all();
+}
+
+/*!
+ * @brief queues a decoded chunk, waits while the reader lags behind
+ * @throw stopped_t if the stream is being destroyed
+ */
+void DecompressingStreambuf::Emit(std::string&& chunk) {
+    if (chunk.empty()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] {
+        return stopped_ || chunks_.size() < g_max_queued_chunks;
+    });
+    if (stopped_) {
+        throw stopped_t{};
+    }
+    chunks_.push_back(std::move(chunk));
+    lock.unlock();
+    changed_.notify_all();
+}
+
+/*!
+ * @brief reads what is available, blocks only if nothing is
+ * @return 0 at the end of the input
+ */
+size_t DecompressingStreambuf::Read(char* dst, size_t size) {
+    std::streamsize available = source_->in_avail();
+    if (available <= 0) {
+        if (traits_type::eq_int_type(source_->sgetc(), traits_type::eof())) {
+            return 0;
+        }
+        available = source_->in_avail();
+    }
+    return static_cast<size_t>(source_->sgetn(
+        dst, std::min<std::streamsize>(size, available)));
+}
+
+/*!
+ * @return false on end of file before the first byte if eof_allowed
+ * @throw std::runtime_error if the file ends in the middle
+ */
+bool DecompressingStreambuf::ReadExactly(void* dst, size_t size,
+                                         bool eof_allowed) {
+    size_t read = static_cast<size_t>(
+        source_->sgetn(static_cast<char*>(dst), size));
+    if (read == size) {
+        return true;
+    }
+    if (read == 0 && eof_allowed) {
+        return false;
+    }
+    throw std::runtime_error("truncated compressed input");
+}
+
+/*!
+ * @brief inflates gzip (or zlib) members one after another
+ */
+void DecompressingStreambuf::DecodeGzip() {
+    z_stream stream{};
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        throw std::runtime_error("can't init zlib");
+    }
+    std::unique_ptr<z_stream, int(*)(z_stream*)> guard(&stream, inflateEnd);
+    std::string in(g_chunk_size, '\0');
+    bool complete{false};
+    for (;;) {
+        if (stream.avail_in == 0) {
+            size_t read = Read(in.data(), in.size());
+            if (!read) {
+                break;
+            }
+            stream.next_in = reinterpret_cast<Bytef*>(in.data());
+            stream.avail_in = static_cast<uInt>(read);
+        }
+        std::string out(g_chunk_size, '\0');
+        stream.next_out = reinterpret_cast<Bytef*>(out.data());
+        stream.avail_out = static_cast<uInt>(out.size());
+        int res = inflate(&stream, Z_NO_FLUSH);
+        if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR) {
+            throw std::runtime_error(std::string("corrupted gzip input: ") +
+                                     (stream.msg ? stream.msg : ""));
+        }
+        complete = res == Z_STREAM_END;
+        out.resize(out.size() - stream.avail_out);
+        Emit(std::move(out));
+        if (complete && inflateReset(&stream) != Z_OK) {
+            throw std::runtime_error("can't reset zlib");
+        }
+    }
+    if (!complete) {
+        throw std::runtime_error("truncated gzip input");
+    }
+}
+
+/*!
+ * @brief decompresses zstd frames one after another
+ */
+void DecompressingStreambuf::DecodeZstd() {
+    std::unique_ptr<ZSTD_DStream, size_t(*)(ZSTD_DStream*)> stream(
+        ZSTD_createDStream(), ZSTD_freeDStream);
+    if (!stream || ZSTD_isError(ZSTD_initDStream(stream.get()))) {
+        throw std::runtime_error("can't init zstd");
+    }
+    std::string in(ZSTD_DStreamInSize(), '\0');
+    size_t hint{0};
+    for (size_t read; (read = Read(in.data(), in.size()));) {
+        ZSTD_inBuffer input{in.data(), read, 0};
+        bool out_full{false};
+        while (input.pos < input.size || out_full) {
+            std::string out(g_chunk_size, '\0');
+            ZSTD_outBuffer output{out.data(), out.size(), 0};
+            hint = ZSTD_decompressStream(stream.get(), &output, &input);
+            if (ZSTD_isError(hint)) {
+                throw std::runtime_error(
+                    std::string("corrupted zstd input: ") +
+                    ZSTD_getErrorName(hint));
+            }
+            out_full = output.pos == output.size;
+            out.resize(output.pos);
+            Emit(std::move(out));
+        }
+    }
+    if (hint != 0) {
+        throw std::runtime_error("truncated zstd input");
+    }
+}
+
+/*!
+ * @brief decodes lz4 frames (the lz4 tool's format) block by block
+ * @details linked blocks are decoded against the previous 64KB of
+ *  output; checksums are skipped, not verified
+ */
+void DecompressingStreambuf::DecodeLz4() {
+    unsigned char header[4];
+    std::string window, block;
+    while (ReadExactly(header, 4, true)) {
+        uint32_t magic = readLe32(header);
+        if ((magic & 0xFFFFFFF0) == g_lz4_skippable_magic) {
+            ReadExactly(header, 4);
+            block.resize(readLe32(header));
+            ReadExactly(block.data(), block.size());
+            continue;
+        }
+        if (magic != g_lz4_frame_magic) {
+            throw std::runtime_error("corrupted lz4 input: bad magic");
+        }
+        unsigned char descriptor[2];
+        ReadExactly(descriptor, 2);
+        unsigned char flags = descriptor[0];
+        unsigned block_size_id = (descriptor[1] >> 4) & 7;
+        if (flags >> 6 != 1 || block_size_id < 4 || (flags & 0x01)) {
+            throw std::runtime_error("unsupported lz4 frame");
+        }
+        bool independent = flags & 0x20;
+        bool block_checksum = flags & 0x10;
+        bool content_checksum = flags & 0x04;
+        size_t max_block_size = size_t{1} << (8 + 2 * block_size_id);
+        unsigned char skipped[9];
+        ReadExactly(skipped, (flags & 0x08 ? 8 : 0) + 1);
+
+        window.clear();
+        for (;;) {
+            ReadExactly(header, 4);
+            uint32_t size = readLe32(header);
+            if (size == 0) {
+                break;
+            }
+            bool compressed = !(size & 0x80000000);
+            size &= 0x7FFFFFFF;
+            if (size > max_block_size) {
+                throw std::runtime_error("corrupted lz4 input: block size");
+            }
+            block.resize(size);
+            ReadExactly(block.data(), size);
+            if (block_checksum) {
+                ReadExactly(skipped, 4);
+            }
+            std::string out;
+            if (compressed) {
+                out.resize(max_block_size);
+                int decoded = LZ4_decompress_safe_usingDict(
+                    block.data(), out.data(), size, out.size(),
+                    independent ? nullptr : window.data(),
+                    independent ? 0 : window.size());
+                if (decoded < 0) {
+                    throw std::runtime_error("corrupted lz4 input");
+                }
+                out.resize(decoded);
+            } else {
+                out = block;
+            }
+            if (!independent) {
+                window.append(out);
+                if (window.size() > g_lz4_window) {
+                    window.erase(0, window.size() - g_lz4_window);
+                }
+            }
+            Emit(std::move(out));
+        }
+        if (content_checksum) {
+            ReadExactly(skipped, 4);
+        }
+    }
+}
+}
+
+compression_t DetectCompression(std::string_view magic) {
+    if (magic.size() >= 2 && magic.substr(0, 2) == "\x1f\x8b") {
+        return compression_t::gzip;
+    }
+    if (magic.size() >= 4) {
+        uint32_t value = readLe32(
+            reinterpret_cast<const unsigned char*>(magic.data()));
+        if (value == 0xFD2FB528) {
+            return compression_t::zstd;
+        }
+        if (value == g_lz4_frame_magic) {
+            return compression_t::lz4;
+        }
+    }
+    return compression_t::none;
+}
+
+namespace {
+/*!
+ * @brief size of the decompressed content of a regular file as far as
+ *  it tells, 0 if it doesn't
+ * @param head first bytes of the file
+ * @details gzip keeps the size of its last member modulo 2^32 in the
+ *  last 4 bytes, zstd and lz4 optionally in the header of a frame;
+ *  only the first frame is looked at
+ */
+uint64_t contentSize(int fd, size_t file_size, compression_t compression,
+                     std::string_view head) {
+    auto bytes = reinterpret_cast<const unsigned char*>(head.data());
+    switch (compression) {
+    case compression_t::none:
+        return file_size;
+    case compression_t::gzip: {
+        unsigned char trailer[4];
+        if (file_size < sizeof(trailer) || ::pread(fd, trailer,
+                sizeof(trailer), file_size - sizeof(trailer)) !=
+                static_cast<ssize_t>(sizeof(trailer))) {
+            return 0;
+        }
+        return readLe32(trailer);
+    }
+    case compression_t::zstd: {
+        auto size = ZSTD_getFrameContentSize(head.data(), head.size());
+        return size == ZSTD_CONTENTSIZE_UNKNOWN ||
+            size == ZSTD_CONTENTSIZE_ERROR ? 0 : size;
+    }
+    case compression_t::lz4:
+        if (head.size() < g_lz4_content_size_end ||
+                !(bytes[4] & g_lz4_content_size_flag)) {
+            return 0;
+        }
+        return readLe64(bytes + 6);
+    }
+    return 0;
+}
+}
+
+/*!
+ * @param path file to read, FIFO, or "-" for stdin
+ * @throw std::runtime_error if can't open the file
+ */
+InputFile::InputFile(const std::string& path): std::istream(nullptr) {
+    bool is_stdin = path == "-";
+    int fd = is_stdin ?
+        STDIN_FILENO : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("can't open file " + path);
+    }
+    auto source = std::make_unique<FdStreambuf>(fd, !is_stdin);
+    compression_ = DetectCompression(source->Peek(4));
+    struct stat info{};
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        content_size_ = contentSize(fd, info.st_size, compression_,
+                                    source->Peek(g_max_frame_header));
+    }
+    if (compression_ == compression_t::none) {
+        buf_ = std::move(source);
+    } else {
+        buf_ = std::make_unique<DecompressingStreambuf>(std::move(source),
+                                                        compression_);
+    }
+    rdbuf(buf_.get());
+    exceptions(std::ios::badbit);
+}
+
+InputFile::~InputFile() = default;
+
+/*!
+ * @brief unread bytes of (decompressed) input, not consumed
+ * @details at most size; fewer near the end of the input or, for a
+ *  compressed one, of its current decoded chunk
+ */
+std::string_view InputFile::Head(size_t size) {
+    if (compression_ == compression_t::none) {
+        return static_cast<FdStreambuf*>(buf_.get())->Peek(size);
+    }
+    return static_cast<DecompressingStreambuf*>(buf_.get())->Peek(size);
+}
+
+/*!
+ * @brief skips bytes of (decompressed) input
+ * @throw std::runtime_error if the input is shorter
+ * @details plain files are seeked, the rest is read through
+ */
+void InputFile::Skip(uint64_t bytes) {
+    if (!bytes || rdbuf()->pubseekoff(static_cast<std::streamoff>(bytes),
+                                      std::ios::cur, std::ios::in) !=
+            std::streampos(std::streamoff(-1))) {
+        return;
+    }
+    constexpr uint64_t step{1 << 30};
+    while (bytes) {
+        std::streamsize size = static_cast<std::streamsize>(
+            std::min(bytes, step));
+        ignore(size);
+        if (gcount() != size) {
+            throw std::runtime_error("input is shorter than expected");
+        }
+        bytes -= size;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+enum class compression_t {
+    none,
+    gzip,
+    zstd,
+    lz4
+};
+
+/*!
+ * @brief detects compression of a file by its first bytes
+ */
+compression_t DetectCompression(std::string_view magic);
+
+/*!
+ * @brief input stream over a plain, gzip, zstd or lz4 (frame) file
+ * @details the file may be a pipe: nothing is seeked, and in_avail()
+ *  tells whether more data is ready without blocking. A compressed
+ *  file is decompressed in a streaming fashion on a thread of its own,
+ *  overlapping with the reader of the stream. Corrupted input throws
+ *  from the stream's reading functions.
+ */
+class InputFile final : public std::istream {
+public:
+    explicit InputFile(const std::string& path);
+    ~InputFile() override;
+
+    compression_t Compression() const { return compression_; }
+    ///> bytes of the decompressed input if the file tells them, else 0
+    uint64_t ContentSize() const { return content_size_; }
+    std::string_view Head(size_t size);
+    void Skip(uint64_t bytes);
+private:
+    std::unique_ptr<std::streambuf> buf_;
+    compression_t compression_{compression_t::none};
+    uint64_t content_size_{0};
+};
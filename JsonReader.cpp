@@ -0,0 +1,32 @@
+#include "JsonReader.hpp"
+#include "nlohmann_json/json.hpp"
+
+#include <string>
+#include <vector>
+
+JsonReader::JsonReader(std::optional<ColumnValidator> validator):
+    validator_{std::move(validator)}
+{}
+
+/*!
+ * @brief reads and parses the whole document
+ * @throw nlohmann::json::exception if the document is malformed
+ */
+rows_t JsonReader::Read(std::istream& input) const {
+    nlohmann::json document;
+    input >> document;
+    auto values =
+        document["data"]["drivers"].get<std::vector<std::string>>();
+    rows_t rows;
+    rows.keys.reserve(values.size());
+    for (auto& value: values) {
+        ++rows.lines;
+        const char* reason = validator_ ? validator_->Check(value) : nullptr;
+        if (reason) {
+            rows.rejects.push_back({rows.lines, std::move(value), reason});
+        } else {
+            rows.keys.push_back(value);
+        }
+    }
+    return rows;
+}
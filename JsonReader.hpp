@@ -0,0 +1,20 @@
+#pragma once
+#include <istream>
+#include <optional>
+
+#include "ColumnValidator.hpp"
+#include "Columns.hpp"
+
+/*!
+ * @brief reads a json document of keys like
+ *  {"data": {"drivers": ["x_1", "y_2"]}}
+ * @details the n-th key is numbered as line n in the rejects
+ */
+class JsonReader final {
+public:
+    explicit JsonReader(std::optional<ColumnValidator> validator = {});
+
+    rows_t Read(std::istream& input) const;
+private:
+    std::optional<ColumnValidator> validator_;
+};
@@ -0,0 +1,111 @@
+#include "LineChunks.hpp"
+#include "InputFile.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+constexpr size_t g_read_step{1 << 20};
+}
+
+std::string readAll(std::istream& input) {
+    std::string text;
+    if (auto file = dynamic_cast<InputFile*>(&input)) {
+        // one more byte, so the end is found without growing
+        text.reserve(file->ContentSize() + 1);
+    }
+    size_t size{0};
+    for (;;) {
+        text.resize(size < text.capacity() ?
+                    text.capacity() : size + g_read_step);
+        size_t wanted = text.size() - size;
+        size_t read = input.rdbuf()->sgetn(text.data() + size, wanted);
+        size += read;
+        if (read < wanted) {
+            break;
+        }
+    }
+    text.resize(size);
+    return text;
+}
+
+size_t estimateLines(std::string_view sample, uint64_t total_bytes) {
+    if (sample.empty() || !total_bytes) {
+        return 0;
+    }
+    size_t lines = std::count(sample.begin(), sample.end(), '\n');
+    if (sample.size() >= total_bytes) {
+        return lines + (sample.back() != '\n');
+    }
+    return total_bytes * std::max<size_t>(lines, 1) / sample.size();
+}
+
+std::vector<std::string_view> splitLines(std::string_view text, size_t parts,
+                                         size_t min_bytes) {
+    parts = std::clamp<size_t>(text.size() / std::max<size_t>(min_bytes, 1),
+                               1, std::max<size_t>(parts, 1));
+    std::vector<std::string_view> chunks;
+    chunks.reserve(parts);
+    size_t begin{0};
+    for (size_t i = 1; i < parts && begin < text.size(); ++i) {
+        size_t end = std::max(begin, text.size() * i / parts);
+        end = text.find('\n', end);
+        if (end == std::string_view::npos) {
+            break;
+        }
+        chunks.push_back(text.substr(begin, end + 1 - begin));
+        begin = end + 1;
+    }
+    if (begin < text.size()) {
+        chunks.push_back(text.substr(begin));
+    }
+    return chunks;
+}
+
+std::vector<std::string_view> splitRecords(std::string_view text,
+                                           size_t parts, size_t min_bytes,
+                                           char quote, char escape) {
+    parts = std::clamp<size_t>(text.size() / std::max<size_t>(min_bytes, 1),
+                               1, std::max<size_t>(parts, 1));
+    std::vector<std::string_view> chunks;
+    chunks.reserve(parts);
+    const char quote_escape[]{quote, escape};
+    bool quoted{false};
+    size_t begin{0}, i{0};
+    for (size_t part = 1; part < parts; ++part) {
+        // only quotes matter up to the split point, memchr finds them
+        size_t target = std::max(begin, text.size() * part / parts);
+        for (;;) {
+            size_t found = quoted && escape != quote ?
+                text.find_first_of(std::string_view(quote_escape, 2), i) :
+                text.find(quote, i);
+            if (found >= target) {
+                break;
+            }
+            if (quoted && text[found] == escape && escape != quote) {
+                i = found + 2;
+                continue;
+            }
+            quoted = !quoted;
+            i = found + 1;
+        }
+        for (i = std::max(i, target); i < text.size(); ++i) {
+            if (quoted && text[i] == escape && escape != quote) {
+                ++i;
+            } else if (text[i] == quote) {
+                quoted = !quoted;
+            } else if (text[i] == '\n' && !quoted) {
+                break;
+            }
+        }
+        if (i >= text.size()) {
+            break;
+        }
+        chunks.push_back(text.substr(begin, i + 1 - begin));
+        begin = ++i;
+    }
+    if (begin < text.size()) {
+        chunks.push_back(text.substr(begin));
+    }
+    return chunks;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstring>
+#include <future>
+#include <istream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+/*!
+ * @brief reads the rest of a stream into memory
+ * @details the content size of an InputFile is reserved up front
+ */
+std::string readAll(std::istream& input);
+
+/*!
+ * @brief number of lines in total_bytes of text, going by sample, the
+ *  start of the text
+ * @return 0 if total_bytes is, e.g. unknown
+ * @details exact if sample is the whole text
+ */
+size_t estimateLines(std::string_view sample, uint64_t total_bytes);
+
+/*!
+ * @brief splits text into at most parts chunks ending with a newline
+ * @param min_bytes chunks aren't made smaller than that, so small
+ *  inputs stay in one chunk
+ * @details every line belongs to exactly one chunk and the chunks
+ *  keep the order of the text, the last one may lack a newline
+ */
+std::vector<std::string_view> splitLines(std::string_view text, size_t parts,
+                                         size_t min_bytes);
+
+/*!
+ * @brief calls on_line for every line of text, without the newline
+ * @details a trailing newline doesn't make an empty last line, like
+ *  std::getline
+ */
+template <typename OnLine>
+void forEachLine(std::string_view text, OnLine&& on_line) {
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    while (begin != end) {
+        auto newline = static_cast<const char*>(
+            std::memchr(begin, '\n', end - begin));
+        const char* line_end = newline ? newline : end;
+        on_line(std::string_view(begin, line_end - begin));
+        begin = newline ? newline + 1 : end;
+    }
+}
+
+/*!
+ * @brief like splitLines but a newline inside a quoted field doesn't
+ *  end a chunk
+ * @param escape makes the next character literal inside quotes; if it
+ *  is the quote itself a doubled quote is literal, as in RFC 4180
+ */
+std::vector<std::string_view> splitRecords(std::string_view text,
+                                           size_t parts, size_t min_bytes,
+                                           char quote, char escape);
+
+/*!
+ * @brief appends values of from to the end of to, for parseChunks
+ */
+template <typename T>
+void appendChunk(std::vector<T>& to, std::vector<T>&& from) {
+    if (to.empty()) {
+        to = std::move(from);
+        return;
+    }
+    to.insert(to.end(), std::make_move_iterator(from.begin()),
+              std::make_move_iterator(from.end()));
+}
+
+/*!
+ * @brief parses chunks of text on threads of their own
+ * @param chunks made by splitLines or splitRecords
+ * @param parse_chunk takes a chunk, returns its values
+ * @return values of all chunks in the order of the chunks, joined by
+ *  appendChunk
+ * @throw whatever parse_chunk throws for the first failed chunk
+ */
+template <typename ParseChunk>
+auto parseChunks(const std::vector<std::string_view>& chunks,
+                 const ParseChunk& parse_chunk)
+        -> decltype(parse_chunk(std::string_view{})) {
+    typedef decltype(parse_chunk(std::string_view{})) values_t;
+    if (chunks.size() <= 1) {
+        return parse_chunk(chunks.empty() ? std::string_view{} : chunks[0]);
+    }
+    ThreadPool pool(chunks.size());
+    std::vector<std::future<values_t>> parsed;
+    parsed.reserve(chunks.size());
+    for (auto chunk: chunks) {
+        parsed.push_back(pool.Submit([&parse_chunk, chunk] {
+            return parse_chunk(chunk);
+        }));
+    }
+    std::vector<values_t> chunk_values;
+    size_t size{0};
+    for (auto& chunk: parsed) {
+        chunk_values.push_back(chunk.get());
+        size += chunk_values.back().size();
+    }
+    values_t values = std::move(chunk_values.front());
+    values.reserve(size);
+    for (size_t i = 1; i < chunk_values.size(); ++i) {
+        appendChunk(values, std::move(chunk_values[i]));
+    }
+    return values;
+}
@@ -0,0 +1,97 @@
+#include "NdjsonReader.hpp"
+#include "nlohmann_json/json.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+///> smaller inputs aren't worth a thread
+constexpr size_t g_min_chunk_bytes{1 << 20};
+///> start of a chunk its lines are estimated by
+constexpr size_t g_sample_bytes{64 * 1024};
+}
+
+NdjsonReader::NdjsonReader(std::string_view key_path, size_t threads,
+                           std::optional<ColumnValidator> validator):
+    threads_{std::max<size_t>(threads, 1)}, validator_{std::move(validator)}
+{
+    std::istringstream stream{std::string(key_path)};
+    for (std::string key; std::getline(stream, key, '.');) {
+        key_path_.push_back(key);
+    }
+    if (key_path_.empty()) {
+        throw std::invalid_argument("empty ndjson key path");
+    }
+}
+
+/*!
+ * @brief reads the whole stream and parses it
+ */
+rows_t NdjsonReader::Read(std::istream& input) const {
+    return Parse(readAll(input));
+}
+
+/*!
+ * @brief parses line aligned chunks of text in parallel
+ */
+rows_t NdjsonReader::Parse(std::string_view text) const {
+    return parseChunks(splitLines(text, threads_, g_min_chunk_bytes),
+                       [this] (std::string_view chunk) {
+        rows_t rows;
+        rows.reserve(estimateLines(chunk.substr(0, g_sample_bytes),
+                                   chunk.size()));
+        forEachLine(chunk, [&] (std::string_view line) {
+            ParseLine(line, rows);
+        });
+        return rows;
+    });
+}
+
+void NdjsonReader::ParseRecord(std::string_view line, const layout_t&,
+                               rows_t& rows) const {
+    ParseLine(line, rows);
+}
+
+/*!
+ * @details a line which isn't an object with the key or whose key
+ *  fails the validator is added to the rejects
+ */
+void NdjsonReader::ParseLine(std::string_view line, rows_t& rows) const {
+    ++rows.lines;
+    if (line.find_first_not_of(" \t\r") == std::string_view::npos) {
+        return;
+    }
+    std::string key;
+    const char* reason = Key(line, key);
+    if (!reason && validator_) {
+        reason = validator_->Check(key);
+    }
+    if (reason) {
+        rows.rejects.push_back({rows.lines, std::string(line), reason});
+        return;
+    }
+    rows.keys.push_back(key);
+}
+
+/*!
+ * @brief takes the value at the key path of one line
+ * @param [out] key the value, a non string value in its json form
+ * @return nullptr or why there is no key
+ */
+const char* NdjsonReader::Key(std::string_view line, std::string& key) const {
+    auto object = nlohmann::json::parse(line.begin(), line.end(), nullptr,
+                                        false);
+    if (object.is_discarded()) {
+        return "malformed json";
+    }
+    const nlohmann::json* node = &object;
+    for (const auto& name: key_path_) {
+        auto found = node->find(name);
+        if (found == node->end()) {
+            return "no key";
+        }
+        node = &*found;
+    }
+    key = node->is_string() ? node->get<std::string>() : node->dump();
+    return nullptr;
+}
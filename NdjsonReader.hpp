@@ -0,0 +1,44 @@
+#pragma once
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ColumnValidator.hpp"
+#include "Columns.hpp"
+#include "LineChunks.hpp"
+
+/*!
+ * @brief reads JSON Lines (NDJSON), one object per line, taking the
+ *  value found at a key path of every object
+ * @details a file is split at newlines into chunks parsed on threads
+ *  of their own, the values keep the order of the lines. Malformed
+ *  lines and keys failing the validator become rejects of the rows.
+ */
+class NdjsonReader final {
+public:
+    ///> every line is a record of the key alone, see CsvReader::layout_t
+    struct layout_t {
+        rows_t rows;
+    };
+
+    ///> key_path is dot separated, e.g. "driver.hash_id"
+    NdjsonReader(std::string_view key_path, size_t threads,
+                 std::optional<ColumnValidator> validator = {});
+
+    rows_t Read(std::istream& input) const;
+    rows_t Parse(std::string_view text) const;
+    bool HasHeader() const { return false; }
+    layout_t Layout(std::optional<std::string_view> = {}) const { return {}; }
+    ///> adds the key of a line to rows, a blank line is skipped
+    void ParseRecord(std::string_view line, const layout_t& layout,
+                     rows_t& rows) const;
+private:
+    void ParseLine(std::string_view line, rows_t& rows) const;
+    const char* Key(std::string_view line, std::string& key) const;
+
+    std::vector<std::string> key_path_;
+    size_t threads_;
+    std::optional<ColumnValidator> validator_;
+};
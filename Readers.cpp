@@ -0,0 +1,77 @@
+#include "Readers.hpp"
+#include "nlohmann_json/json.hpp"
+
+namespace {
+///> skips a UTF-8 byte order mark and leading whitespace
+std::string_view skipBlank(std::string_view head) {
+    if (head.substr(0, 3) == "\xEF\xBB\xBF") {
+        head.remove_prefix(3);
+    }
+    size_t begin = head.find_first_not_of(" \t\r\n");
+    return begin == std::string_view::npos ?
+        std::string_view{} : head.substr(begin);
+}
+}
+
+/*!
+ * @details an object, unless its first line is a whole one
+ */
+int reader_traits<JsonReader>::Sniff(std::string_view head) {
+    head = skipBlank(head);
+    return !head.empty() && head[0] == '{' ? 2 : 0;
+}
+
+bool reader_traits<JsonReader>::Claims(std::string_view extension) {
+    return extension == "json";
+}
+
+/*!
+ * @details the first line has to be a whole object; one longer than
+ *  head can't be told from a json document
+ */
+int reader_traits<NdjsonReader>::Sniff(std::string_view head) {
+    head = skipBlank(head);
+    if (head.empty() || head[0] != '{') {
+        return 0;
+    }
+    std::string_view line = head.substr(0, head.find('\n'));
+    return nlohmann::json::accept(line.begin(), line.end()) ? 3 : 0;
+}
+
+bool reader_traits<NdjsonReader>::Claims(std::string_view extension) {
+    return extension == "ndjson" || extension == "jsonl";
+}
+
+/*!
+ * @details above the text formats: a text file is hardly a block
+ *  header of a known type
+ */
+int reader_traits<NativeReader>::Sniff(std::string_view head) {
+    return NativeReader::Sniff(head) ? 4 : 0;
+}
+
+bool reader_traits<NativeReader>::Claims(std::string_view extension) {
+    return extension == "native";
+}
+
+/*!
+ * @details RowBinary has no header to tell it by, it has to be set
+ */
+int reader_traits<RowBinaryReader>::Sniff(std::string_view) {
+    return 0;
+}
+
+bool reader_traits<RowBinaryReader>::Claims(std::string_view extension) {
+    return extension == "rowbinary";
+}
+
+/*!
+ * @details anything is a csv of a key per line, the fallback
+ */
+int reader_traits<CsvReader>::Sniff(std::string_view) {
+    return 1;
+}
+
+bool reader_traits<CsvReader>::Claims(std::string_view extension) {
+    return extension == "csv" || extension == "tsv";
+}
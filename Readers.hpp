@@ -0,0 +1,229 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+#include "BinaryReaders.hpp"
+#include "Columns.hpp"
+#include "CsvReader.hpp"
+#include "JsonReader.hpp"
+#include "NdjsonReader.hpp"
+
+enum class input_format_t {
+    automatic,  ///> sniffed from the first bytes, see ReaderRegistry
+    csv,
+    json,
+    ndjson,     ///> one json object per line
+    native,     ///> ClickHouse Native dump
+    row_binary  ///> ClickHouse RowBinary dump, never sniffed
+};
+
+/*!
+ * @brief chunks of rows of a line based input, a record per line
+ * @details Reader has HasHeader, Layout and ParseRecord like CsvReader;
+ *  they are called on the concrete type, the per line loop has no
+ *  virtual calls
+ */
+template <typename Reader>
+class LineChunkStream final {
+public:
+    ///> reads the header line if the reader's inputs have one
+    LineChunkStream(const Reader& reader, std::istream& input):
+        reader_{reader}, input_{input}
+    {
+        if (reader_.HasHeader() && std::getline(input_, line_)) {
+            layout_ = reader_.Layout(line_);
+            header_bytes_ = line_.size() + (input_.eof() ? 0 : 1);
+            offset_ = header_bytes_;
+        } else {
+            layout_ = reader_.Layout();
+        }
+    }
+
+    ///> rows of the reader's columns without records, to parse into
+    rows_t Empty() const { return layout_.rows; }
+    ///> bytes of the header line, 0 if there is none
+    uint64_t HeaderBytes() const { return header_bytes_; }
+    ///> lines read before the records, for numbering rejects
+    size_t HeaderLines() const { return header_bytes_ ? 1 : 0; }
+    ///> bytes of the input read so far, including skipped ones
+    uint64_t Offset() const { return offset_; }
+    ///> accounts for bytes skipped past the stream, e.g. by InputFile
+    void Skipped(uint64_t bytes) { offset_ += bytes; }
+
+    /*!
+     * @brief parses lines into chunk
+     * @param max_rows stops once chunk has that many rows
+     * @param until_idle stops as well once no more input is ready, so
+     *  rows of a pipe go on while it is open
+     * @return false if the input has ended before a line was read
+     */
+    bool Next(rows_t& chunk, size_t max_rows, bool until_idle) {
+        bool read{false};
+        while (chunk.size() < max_rows && std::getline(input_, line_)) {
+            read = true;
+            offset_ += line_.size() + (input_.eof() ? 0 : 1);
+            reader_.ParseRecord(line_, layout_, chunk);
+            if (until_idle && input_.rdbuf()->in_avail() <= 0) {
+                break;
+            }
+        }
+        return read;
+    }
+private:
+    const Reader& reader_;
+    std::istream& input_;
+    typename Reader::layout_t layout_;
+    std::string line_;
+    uint64_t header_bytes_{0};
+    uint64_t offset_{0};
+};
+
+/*!
+ * @brief the whole input as one chunk, for document formats
+ */
+template <typename Reader>
+class DocumentChunkStream final {
+public:
+    DocumentChunkStream(const Reader& reader, std::istream& input):
+        reader_{reader}, input_{input}
+    {}
+
+    rows_t Empty() const { return {}; }
+    size_t HeaderLines() const { return 0; }
+
+    ///> parses the whole input on the first call
+    bool Next(rows_t& chunk, size_t, bool) {
+        if (done_) {
+            return false;
+        }
+        done_ = true;
+        appendChunk(chunk, reader_.Read(input_));
+        return true;
+    }
+private:
+    const Reader& reader_;
+    std::istream& input_;
+    bool done_{false};
+};
+
+/*!
+ * @brief what the registry knows of a reader
+ * @details a specialization has
+ *  - format: the input_format_t read;
+ *  - stream_t: its chunk stream, line_based if a LineChunkStream;
+ *  - Sniff(head): how sure it is the first bytes are of its format,
+ *    0 if they aren't;
+ *  - Claims(extension): whether files named so are of its format.
+ */
+template <typename Reader>
+struct reader_traits;
+
+template <>
+struct reader_traits<JsonReader> {
+    static constexpr input_format_t format{input_format_t::json};
+    static constexpr bool line_based{false};
+    typedef DocumentChunkStream<JsonReader> stream_t;
+    static int Sniff(std::string_view head);
+    static bool Claims(std::string_view extension);
+};
+
+template <>
+struct reader_traits<NdjsonReader> {
+    static constexpr input_format_t format{input_format_t::ndjson};
+    static constexpr bool line_based{true};
+    typedef LineChunkStream<NdjsonReader> stream_t;
+    static int Sniff(std::string_view head);
+    static bool Claims(std::string_view extension);
+};
+
+template <>
+struct reader_traits<NativeReader> {
+    static constexpr input_format_t format{input_format_t::native};
+    static constexpr bool line_based{false};
+    typedef DocumentChunkStream<NativeReader> stream_t;
+    static int Sniff(std::string_view head);
+    static bool Claims(std::string_view extension);
+};
+
+template <>
+struct reader_traits<RowBinaryReader> {
+    static constexpr input_format_t format{input_format_t::row_binary};
+    static constexpr bool line_based{false};
+    typedef DocumentChunkStream<RowBinaryReader> stream_t;
+    static int Sniff(std::string_view head);
+    static bool Claims(std::string_view extension);
+};
+
+template <>
+struct reader_traits<CsvReader> {
+    static constexpr input_format_t format{input_format_t::csv};
+    static constexpr bool line_based{true};
+    typedef LineChunkStream<CsvReader> stream_t;
+    static int Sniff(std::string_view head);
+    static bool Claims(std::string_view extension);
+};
+
+/*!
+ * @brief readers of the formats known at compile time
+ * @details a format plugs in with a reader class, its reader_traits
+ *  and a place in readers_t. Visit picks the reader once per input
+ *  and calls the visitor with its concrete type, so the loops within
+ *  are devirtualized.
+ */
+template <typename... Readers>
+class ReaderRegistry final {
+public:
+    explicit ReaderRegistry(Readers... readers):
+        readers_{std::move(readers)...}
+    {}
+
+    /*!
+     * @brief format of an input by its first bytes
+     * @param extension of the input's name; breaks ties between
+     *  formats which sniff alike, e.g. a one line json document
+     * @details the first of the readers sure the most wins
+     */
+    input_format_t Detect(std::string_view head,
+                          std::string_view extension) const {
+        input_format_t format{input_format_t::automatic};
+        int best{0};
+        ([&] {
+            int score = reader_traits<Readers>::Sniff(head);
+            if (score > 0 && reader_traits<Readers>::Claims(extension)) {
+                ++score;
+            }
+            if (score > best) {
+                best = score;
+                format = reader_traits<Readers>::format;
+            }
+        }(), ...);
+        if (format == input_format_t::automatic) {
+            throw std::invalid_argument("unknown input format");
+        }
+        return format;
+    }
+
+    /*!
+     * @brief calls visitor with the reader of format
+     * @throw std::invalid_argument if no reader has the format
+     */
+    template <typename Visitor>
+    void Visit(input_format_t format, Visitor&& visitor) const {
+        bool visited = std::apply([&] (const Readers&... reader) {
+            return ((reader_traits<Readers>::format == format &&
+                     (visitor(reader), true)) || ...);
+        }, readers_);
+        if (!visited) {
+            throw std::invalid_argument("no reader of the input format");
+        }
+    }
+private:
+    std::tuple<Readers...> readers_;
+};
+
+typedef ReaderRegistry<JsonReader, NdjsonReader, NativeReader,
+                       RowBinaryReader, CsvReader> readers_t;
@@ -0,0 +1,96 @@
+#include "SnowflakeIdGenerator.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+/// registry of thread indexes, an index is reused after its thread exits
+class thread_indexes_t {
+public:
+    unsigned Acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.empty()) {
+            return next_++;
+        }
+        unsigned index = free_.back();
+        free_.pop_back();
+        return index;
+    }
+    void Release(unsigned index) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(index);
+    }
+private:
+    std::mutex mutex_;
+    std::vector<unsigned> free_;
+    unsigned next_{0};
+};
+
+thread_indexes_t g_thread_indexes;
+
+struct thread_index_holder {
+    unsigned index{g_thread_indexes.Acquire()};
+    ~thread_index_holder() { g_thread_indexes.Release(index); }
+};
+}
+
+SnowflakeIdGenerator::SnowflakeIdGenerator(uint64_t worker_id,
+                                           unsigned thread_bits):
+    worker_id_{worker_id}, thread_bits_{thread_bits}
+{
+    if (thread_bits_ > worker_bits) {
+        throw std::invalid_argument("thread bits exceed worker bits");
+    }
+    if (worker_id_ >> (worker_bits - thread_bits_)) {
+        throw std::invalid_argument("worker id " +
+            std::to_string(worker_id_) + " doesn't fit into " +
+            std::to_string(worker_bits - thread_bits_) + " bits");
+    }
+}
+
+/*!
+ * @brief gives every live thread of the process a distinct small index
+ * @details a thread taking over an index continues its predecessor's
+ *  sequence, the registry mutex orders their accesses to the slot
+ */
+unsigned SnowflakeIdGenerator::ThreadIndex() {
+    thread_local thread_index_holder holder;
+    return holder.index;
+}
+
+/*!
+ * @brief makes an id from the calling thread's own slot
+ * @throw std::runtime_error if more threads than thread slots use it
+ * @details when a thread exhausts the sequence within a millisecond
+ *  it borrows the next one instead of spinning
+ */
+uint64_t SnowflakeIdGenerator::Next() {
+    unsigned thread = ThreadIndex();
+    if (thread >> thread_bits_) {
+        throw std::runtime_error("out of snowflake thread slots");
+    }
+    slot_t& slot = slots_[thread];
+    uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() - epoch_ms;
+    if (now_ms > slot.last_ms) {
+        slot.last_ms = now_ms;
+        slot.sequence = 0;
+    } else if (++slot.sequence >> sequence_bits) {
+        ++slot.last_ms;
+        slot.sequence = 0;
+    }
+    uint64_t worker = (worker_id_ << thread_bits_) | thread;
+    return (slot.last_ms << (worker_bits + sequence_bits)) |
+           (worker << sequence_bits) | slot.sequence;
+}
+
+void SnowflakeIdGenerator::Generate(size_t count, uint64_t,
+                                    std::vector<uint64_t>& ids) {
+    ids.reserve(ids.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+        ids.push_back(Next());
+    }
+}
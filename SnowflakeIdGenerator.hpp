@@ -0,0 +1,43 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+#include "IdAllocator.hpp"
+
+/*!
+ * @brief time ordered 64-bit ids: | 41 bit ms | 10 bit worker | 12 bit seq |
+ * @details the worker field is split into a process wide worker id and
+ *  a slot of the calling thread, so every thread counts on its own
+ *  without any synchronization and no max id lookup is needed
+ */
+class SnowflakeIdGenerator final : public IdGenerator {
+public:
+    static constexpr unsigned timestamp_bits = 41;
+    static constexpr unsigned worker_bits = 10;
+    static constexpr unsigned sequence_bits = 12;
+    static constexpr uint64_t epoch_ms = 1609459200000; ///> 2021-01-01
+
+    /*!
+     * @param worker_id id of this process, < 2^(worker_bits - thread_bits)
+     * @param thread_bits bits of the worker field given to thread slots
+     */
+    explicit SnowflakeIdGenerator(uint64_t worker_id,
+                                  unsigned thread_bits = 4);
+
+    uint64_t Next();
+    void Generate(size_t count, uint64_t current_max_id,
+                  std::vector<uint64_t>& ids) override;
+private:
+    static constexpr unsigned max_threads = 1u << worker_bits;
+
+    struct alignas(64) slot_t {
+        uint64_t last_ms{0};
+        uint64_t sequence{0};
+    };
+
+    static unsigned ThreadIndex();
+
+    uint64_t worker_id_;
+    unsigned thread_bits_;
+    std::array<slot_t, max_threads> slots_{};
+};
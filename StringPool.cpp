@@ -0,0 +1,160 @@
+#include "StringPool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+constexpr size_t g_min_slots{16};
+///> the table grows at 3/4 full
+constexpr size_t g_max_load_num{3}, g_max_load_den{4};
+}
+
+/*!
+ * @param bytes of all the strings, unknown if 0
+ */
+void StringPool::reserve(size_t strings, size_t bytes) {
+    ends_.reserve(strings);
+    chars_.reserve(bytes);
+}
+
+void StringPool::clear() {
+    chars_.clear();
+    ends_.clear();
+}
+
+void StringPool::Truncate(size_t strings) {
+    if (strings >= ends_.size()) {
+        return;
+    }
+    ends_.resize(strings);
+    chars_.resize(strings ? ends_.back() : 0);
+}
+
+void StringPool::Erase(const std::vector<size_t>& strings) {
+    if (strings.empty()) {
+        return;
+    }
+    size_t to{strings[0]}, next{0};
+    uint64_t end{to ? ends_[to - 1] : 0};
+    for (size_t from = to; from < ends_.size(); ++from) {
+        if (next < strings.size() && strings[next] == from) {
+            ++next;
+            continue;
+        }
+        std::string_view value = (*this)[from];
+        std::memmove(chars_.data() + end, value.data(), value.size());
+        end += value.size();
+        ends_[to++] = end;
+    }
+    ends_.resize(to);
+    chars_.resize(end);
+}
+
+void StringPool::Append(const StringPool& other) {
+    uint64_t base = chars_.size();
+    chars_.append(other.chars_);
+    ends_.reserve(ends_.size() + other.ends_.size());
+    for (uint64_t end: other.ends_) {
+        ends_.push_back(base + end);
+    }
+}
+
+size_t StringPool::Capacity() const {
+    return chars_.capacity() + ends_.capacity() * sizeof(ends_[0]);
+}
+
+/*!
+ * @throw std::length_error past 2^32 - 1 keys
+ */
+bool KeySet::insert(std::string_view key) {
+    if ((keys_.size() + 1) * g_max_load_den > slots_.size() * g_max_load_num) {
+        Rehash(std::max(slots_.size() * 2, g_min_slots));
+    }
+    uint32_t hash = Hash(key);
+    slot_t& slot = slots_[Find(key, hash)];
+    if (slot.key) {
+        return false;
+    }
+    if (keys_.size() == std::numeric_limits<uint32_t>::max()) {
+        throw std::length_error("too many keys");
+    }
+    keys_.push_back(key);
+    slot = {static_cast<uint32_t>(keys_.size()), hash};
+    return true;
+}
+
+bool KeySet::contains(std::string_view key) const {
+    return !slots_.empty() && slots_[Find(key, Hash(key))].key;
+}
+
+/*!
+ * @param bytes of all the keys, unknown if 0
+ */
+void KeySet::reserve(size_t keys, size_t bytes) {
+    keys_.reserve(keys, bytes);
+    size_t slots{g_min_slots};
+    while (keys * g_max_load_den > slots * g_max_load_num) {
+        slots *= 2;
+    }
+    if (slots > slots_.size()) {
+        Rehash(slots);
+    }
+}
+
+void KeySet::clear() {
+    keys_.clear();
+    slots_.assign(slots_.size(), slot_t{0, 0});
+}
+
+size_t KeySet::Capacity() const {
+    return keys_.Capacity() + slots_.capacity() * sizeof(slot_t);
+}
+
+uint32_t KeySet::Hash(std::string_view key) {
+    return static_cast<uint32_t>(std::hash<std::string_view>{}(key));
+}
+
+/*!
+ * @details Fibonacci hashing: the top bits of the product depend on
+ *  all bits of hash
+ */
+size_t KeySet::Home(uint32_t hash) const {
+    return (hash * 0x9E3779B97F4A7C15ull) >> shift_;
+}
+
+size_t KeySet::Find(std::string_view key, uint32_t hash) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t i = Home(hash);; i = (i + 1) & mask) {
+        const slot_t& slot = slots_[i];
+        if (!slot.key ||
+                (slot.hash == hash && keys_[slot.key - 1] == key)) {
+            return i;
+        }
+    }
+}
+
+/*!
+ * @param slots a power of 2
+ */
+void KeySet::Rehash(size_t slots) {
+    std::vector<slot_t> old(slots, slot_t{0, 0});
+    old.swap(slots_);
+    shift_ = 64;
+    for (size_t size = slots; size > 1; size /= 2) {
+        --shift_;
+    }
+    size_t mask = slots - 1;
+    for (const slot_t& slot: old) {
+        if (!slot.key) {
+            continue;
+        }
+        size_t i = Home(slot.hash);
+        while (slots_[i].key) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = slot;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*!
+ * @brief strings laid out like a ClickHouse ColumnString: the bytes of
+ *  all of them in one buffer and where each one ends
+ * @details a string takes its length plus 8 bytes
+ */
+class StringPool final {
+public:
+    size_t size() const { return ends_.size(); }
+    bool empty() const { return ends_.empty(); }
+    std::string_view operator[](size_t i) const {
+        uint64_t begin = i ? ends_[i - 1] : 0;
+        return {chars_.data() + begin, ends_[i] - begin};
+    }
+    void push_back(std::string_view value) {
+        chars_.append(value.data(), value.size());
+        ends_.push_back(chars_.size());
+    }
+    void reserve(size_t strings, size_t bytes = 0);
+    void clear();
+    ///> drops the strings from the given one on
+    void Truncate(size_t strings);
+    ///> drops the given strings, in ascending order
+    void Erase(const std::vector<size_t>& strings);
+    void Append(const StringPool& other);
+    ///> bytes of the strings
+    size_t Bytes() const { return chars_.size(); }
+    ///> bytes the pool holds
+    size_t Capacity() const;
+private:
+    std::string chars_;
+    std::vector<uint64_t> ends_;
+};
+
+/*!
+ * @brief set of strings kept in a StringPool and indexed by an open
+ *  addressing table of 32-bit pool positions with their cached hashes
+ * @details a key takes its length plus about 20 bytes instead of the
+ *  60 or more of a std::unordered_set<std::string> node; growing the
+ *  table doesn't touch the strings
+ */
+class KeySet final {
+public:
+    ///> @return false if an equal key is there already
+    bool insert(std::string_view key);
+    bool contains(std::string_view key) const;
+    size_t size() const { return keys_.size(); }
+    void reserve(size_t keys, size_t bytes = 0);
+    void clear();
+    ///> the keys in the order of insertion
+    const StringPool& Keys() const { return keys_; }
+    ///> bytes the set holds
+    size_t Capacity() const;
+private:
+    struct slot_t {
+        uint32_t key;   ///> position in keys_ + 1, 0 if the slot is free
+        uint32_t hash;
+    };
+
+    static uint32_t Hash(std::string_view key);
+    size_t Home(uint32_t hash) const;
+    ///> the slot of an equal key or the free one it would take
+    size_t Find(std::string_view key, uint32_t hash) const;
+    void Rehash(size_t slots);
+
+    StringPool keys_;
+    std::vector<slot_t> slots_;
+    unsigned shift_{64};    ///> 64 - log2 of slots_.size()
+};
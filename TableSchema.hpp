@@ -0,0 +1,220 @@
+#pragma once
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Columns.hpp"
+
+/*!
+ * @file
+ * @brief tables declared as C++ structs: the struct lists its columns
+ *  in a constexpr tuple of fields, first the id, then the key
+ * @code
+ *  struct driver_t {
+ *      uint64_t id;
+ *      std::string hash_id;
+ *      uint8_t rating;
+ *      static constexpr auto columns = std::make_tuple(
+ *          field(&driver_t::id, "id"),
+ *          field(&driver_t::hash_id, "hash_id"),
+ *          field(&driver_t::rating, "rating"));
+ *  };
+ * @endcode
+ *  the DDL and the select list of the dedup snapshot are made at
+ *  compile time and a field of a type without a column is a build error
+ */
+
+///> the ClickHouse type of a field, undefined for unsupported ones
+template <typename T>
+struct column_type;
+
+template <> struct column_type<uint8_t> {
+    static constexpr std::string_view name{"UInt8"};
+};
+template <> struct column_type<uint16_t> {
+    static constexpr std::string_view name{"UInt16"};
+};
+template <> struct column_type<uint32_t> {
+    static constexpr std::string_view name{"UInt32"};
+};
+template <> struct column_type<uint64_t> {
+    static constexpr std::string_view name{"UInt64"};
+};
+template <> struct column_type<int8_t> {
+    static constexpr std::string_view name{"Int8"};
+};
+template <> struct column_type<int16_t> {
+    static constexpr std::string_view name{"Int16"};
+};
+template <> struct column_type<int32_t> {
+    static constexpr std::string_view name{"Int32"};
+};
+template <> struct column_type<int64_t> {
+    static constexpr std::string_view name{"Int64"};
+};
+template <> struct column_type<float> {
+    static constexpr std::string_view name{"Float32"};
+};
+template <> struct column_type<double> {
+    static constexpr std::string_view name{"Float64"};
+};
+template <> struct column_type<std::string> {
+    static constexpr std::string_view name{"String"};
+};
+template <> struct column_type<date_t> {
+    static constexpr std::string_view name{"Date"};
+};
+template <> struct column_type<date_time_t> {
+    static constexpr std::string_view name{"DateTime"};
+};
+
+///> a column of Table kept in its member of type T
+template <typename Table, typename T>
+struct field_t {
+    typedef T type;
+    T Table::* member;
+    std::string_view name;
+};
+
+template <typename Table, typename T>
+constexpr field_t<Table, T> field(T Table::* member, std::string_view name) {
+    return {member, name};
+}
+
+/*!
+ * @brief what is known of a table struct at compile time
+ * @details Table::columns is checked here: at least the id and the key,
+ *  a UInt64 id and a String or UInt64 key, as ClickhouseFiller needs
+ */
+template <typename Table>
+struct table_schema {
+    static constexpr const auto& columns = Table::columns;
+    static constexpr size_t size =
+        std::tuple_size_v<std::decay_t<decltype(Table::columns)>>;
+    template <size_t I>
+    using type = typename std::tuple_element_t<
+        I, std::decay_t<decltype(Table::columns)>>::type;
+
+    static_assert(size >= 2, "a table needs an id and a key");
+    static_assert(std::is_same_v<type<0>, uint64_t>,
+                  "the id has to be a uint64_t");
+    static_assert(std::is_same_v<type<1>, std::string> ||
+                  std::is_same_v<type<1>, uint64_t>,
+                  "the key has to be a std::string or a uint64_t");
+
+    ///> length of "(id UInt64, key String)" or "id, key" of count columns
+    template <bool types, size_t count>
+    static constexpr size_t Length() {
+        size_t length = types ? 2 : 0;
+        std::apply([&] (const auto&... fields) {
+            size_t column{0};
+            ((length += column++ < count ? fields.name.size() + (types ?
+                1 + column_type<typename std::decay_t<
+                    decltype(fields)>::type>::name.size() : 0) : 0), ...);
+        }, columns);
+        return length + (count - 1) * 2;
+    }
+
+    template <bool types, size_t count>
+    static constexpr std::array<char, Length<types, count>()> Format() {
+        std::array<char, Length<types, count>()> text{};
+        size_t at{0};
+        auto put = [&] (std::string_view part) {
+            for (char c: part) {
+                text[at++] = c;
+            }
+        };
+        if (types) {
+            put("(");
+        }
+        std::apply([&] (const auto&... fields) {
+            size_t column{0};
+            ((column < count ?
+              (put(column ? ", " : ""), put(fields.name),
+               types ? (put(" "), put(column_type<typename std::decay_t<
+                   decltype(fields)>::type>::name)) : void()) : void(),
+              ++column), ...);
+        }, columns);
+        if (types) {
+            put(")");
+        }
+        return text;
+    }
+
+    static constexpr auto creation{Format<true, size>()};
+    static constexpr auto select{Format<false, 2>()};
+
+    ///> e.g. "(id UInt64, hash_id String)"
+    static constexpr std::string_view CreationScheme() {
+        return {creation.data(), creation.size()};
+    }
+    ///> the id and the key the snapshot selects, e.g. "id, hash_id"
+    static constexpr std::string_view SelectScheme() {
+        return {select.data(), select.size()};
+    }
+
+    ///> names and types as in ClickhouseFiller::scheme_t
+    static std::vector<std::pair<std::string, std::string>> Scheme() {
+        std::vector<std::pair<std::string, std::string>> scheme;
+        std::apply([&] (const auto&... fields) {
+            (scheme.emplace_back(fields.name, column_type<typename
+                std::decay_t<decltype(fields)>::type>::name), ...);
+        }, columns);
+        return scheme;
+    }
+
+    /*!
+     * @brief the keys and the columns but the id of records, as a
+     *  reader reads them
+     * @details a column is filled at a time from its member by a typed
+     *  loop; from then on the records take the runtime path of read
+     *  rows, columns_t and all. UInt64 keys are kept as numbers, so
+     *  they aren't parsed, and as text for the checks on keys.
+     */
+    static rows_t Rows(const std::vector<Table>& records) {
+        rows_t rows;
+        rows.reserve(records.size());
+        auto key = std::get<1>(columns).member;
+        if constexpr (std::is_same_v<type<1>, uint64_t>) {
+            rows.integer_keys.reserve(records.size());
+        }
+        for (const Table& record: records) {
+            if constexpr (std::is_same_v<type<1>, std::string>) {
+                rows.keys.push_back(record.*key);
+            } else {
+                char text[20];
+                auto end = std::to_chars(text, text + sizeof(text),
+                                         record.*key).ptr;
+                rows.keys.push_back({text, static_cast<size_t>(end - text)});
+                rows.integer_keys.push_back(record.*key);
+            }
+        }
+        AppendColumns(rows.columns, records,
+                      std::make_index_sequence<size - 2>{});
+        rows.lines = records.size();
+        return rows;
+    }
+private:
+    template <size_t... I>
+    static void AppendColumns(columns_t& to, const std::vector<Table>& records,
+                              std::index_sequence<I...>) {
+        (AppendColumn(to, records, std::get<I + 2>(columns)), ...);
+    }
+
+    template <typename T>
+    static void AppendColumn(columns_t& to, const std::vector<Table>& records,
+                             const field_t<Table, T>& field) {
+        std::vector<T> values;
+        values.reserve(records.size());
+        for (const Table& record: records) {
+            values.push_back(record.*field.member);
+        }
+        to.push_back({std::string(field.name), std::move(values)});
+    }
+};
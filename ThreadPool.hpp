@@ -0,0 +1,48 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/*!
+ * @brief fixed number of threads running submitted tasks in FIFO order
+ */
+class ThreadPool final {
+public:
+    explicit ThreadPool(size_t threads);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    size_t Size() const { return workers_.size(); }
+
+    /*!
+     * @brief queues a task
+     * @return future of the task's result or exception
+     */
+    template <typename Task>
+    auto Submit(Task&& task) -> std::future<decltype(task())> {
+        typedef decltype(task()) result_t;
+        auto packaged = std::make_shared<std::packaged_task<result_t()>>(
+            std::forward<Task>(task));
+        auto result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace([packaged] { (*packaged)(); });
+        }
+        has_tasks_.notify_one();
+        return result;
+    }
+private:
+    void Work();
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    bool stopped_{false};
+};
@@ -0,0 +1,374 @@
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+#include <malloc.h>
+
+#include <fmt/format.h>
+#include <lz4.h>
+#ifdef CHFILLER_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "BinaryReaders.hpp"
+#include "ColumnValidator.hpp"
+#include "CsvReader.hpp"
+#include "FlatSet.hpp"
+#include "InputFile.hpp"
+#include "NdjsonReader.hpp"
+#include "SnowflakeIdGenerator.hpp"
+#include "StringPool.hpp"
+
+namespace {
+typedef std::chrono::steady_clock bench_clock_t;
+
+double seconds_since(bench_clock_t::time_point start) {
+    return std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+/*!
+ * @brief ids per second of one generator shared by 1..16 threads
+ */
+void snowflake_ids_bench() {
+    constexpr size_t ids_per_thread{4'000'000};
+    std::cout << "snowflake ids" << std::endl;
+    for (unsigned threads: {1u, 2u, 4u, 8u, 16u}) {
+        SnowflakeIdGenerator generator(0, 4);
+        std::vector<uint64_t> checksums(threads);
+        std::vector<std::thread> workers;
+        auto start = bench_clock_t::now();
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                uint64_t checksum{0};
+                for (size_t i = 0; i < ids_per_thread; ++i) {
+                    checksum ^= generator.Next();
+                }
+                checksums[t] = checksum;
+            });
+        }
+        for (auto& worker: workers) {
+            worker.join();
+        }
+        double elapsed = seconds_since(start);
+        std::cout << fmt::format("  threads: {:2}; ids/s: {:.3e}",
+            threads, threads * ids_per_thread / elapsed) << std::endl;
+    }
+}
+
+/*!
+ * @brief makes (id, hash_id) rows as the native protocol sends them:
+ *  sequential UInt64 ids followed by varint prefixed 10 char hash_ids
+ *  like "x_iihwbfv1"
+ */
+std::string make_hash_id_block(size_t rows) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    std::mt19937_64 rng{42};
+    std::string block;
+    for (uint64_t id = 1; id <= rows; ++id) {
+        block.append(reinterpret_cast<const char*>(&id), sizeof(id));
+    }
+    for (size_t i = 0; i < rows; ++i) {
+        block.push_back(10);
+        block.push_back(alphabet[rng() % 26]);
+        block.push_back('_');
+        for (int c = 0; c < 8; ++c) {
+            block.push_back(alphabet[rng() % (sizeof(alphabet) - 1)]);
+        }
+    }
+    return block;
+}
+
+struct codec_t {
+    std::string name;
+    std::function<size_t(const std::string&, std::string&)> compress;
+    std::function<void(const std::string&, size_t, std::string&)> decompress;
+};
+
+/*!
+ * @brief CPU cost against bytes on the wire of the client's codecs
+ * @details the data is split into 1MB chunks like the client does with
+ *  blocks; pick the codec whose compress + decompress throughput stays
+ *  above the link bandwidth divided by its ratio
+ */
+void compression_bench() {
+    constexpr size_t chunk_bytes{1 << 20};
+    const std::string data{make_hash_id_block(4'000'000)};
+    std::vector<codec_t> codecs{
+        {"lz4",
+         [] (const std::string& src, std::string& dst) {
+             dst.resize(LZ4_compressBound(src.size()));
+             return static_cast<size_t>(LZ4_compress_default(src.data(),
+                 dst.data(), src.size(), dst.size()));
+         },
+         [] (const std::string& src, size_t size, std::string& dst) {
+             LZ4_decompress_safe(src.data(), dst.data(), size, dst.size());
+         }},
+#ifdef CHFILLER_WITH_ZSTD
+        {"zstd",
+         [] (const std::string& src, std::string& dst) {
+             dst.resize(ZSTD_compressBound(src.size()));
+             return ZSTD_compress(dst.data(), dst.size(),
+                                  src.data(), src.size(), 1);
+         },
+         [] (const std::string& src, size_t size, std::string& dst) {
+             ZSTD_decompress(dst.data(), dst.size(), src.data(), size);
+         }},
+#endif
+    };
+    std::cout << "compression of " << data.size() << " bytes" << std::endl;
+    std::cout << "  none: wire bytes: " << data.size() << std::endl;
+    for (const auto& codec: codecs) {
+        size_t wire_bytes{0};
+        double compress_s{0}, decompress_s{0};
+        std::string chunk, compressed, restored;
+        for (size_t offset = 0; offset < data.size(); offset += chunk_bytes) {
+            chunk = data.substr(offset, chunk_bytes);
+            auto start = bench_clock_t::now();
+            size_t size = codec.compress(chunk, compressed);
+            compress_s += seconds_since(start);
+            restored.resize(chunk.size());
+            start = bench_clock_t::now();
+            codec.decompress(compressed, size, restored);
+            decompress_s += seconds_since(start);
+            if (restored != chunk) {
+                throw std::runtime_error(codec.name + " round trip failed");
+            }
+            wire_bytes += size;
+        }
+        std::cout << fmt::format("  {}: wire bytes: {}; ratio: {:.2f}; "
+                                 "compress MB/s: {:.0f}; "
+                                 "decompress MB/s: {:.0f}",
+            codec.name, wire_bytes, double(data.size()) / wire_bytes,
+            data.size() / compress_s / 1e6, data.size() / decompress_s / 1e6)
+            << std::endl;
+    }
+}
+
+/*!
+ * @brief MB/s of one ndjson file parsed by 1..16 threads
+ */
+void ndjson_bench() {
+    constexpr size_t lines{1'000'000};
+    std::string text;
+    for (size_t i = 0; i < lines; ++i) {
+        text += fmt::format("{{\"driver\": {{\"hash_id\": \"d_{:08}\", "
+                            "\"name\": \"driver {}\", \"rating\": {}}}}}\n",
+                            i, i, i % 5);
+    }
+    std::cout << "ndjson of " << text.size() << " bytes" << std::endl;
+    for (unsigned threads: {1u, 2u, 4u, 8u, 16u}) {
+        NdjsonReader reader("driver.hash_id", threads);
+        auto start = bench_clock_t::now();
+        auto keys = reader.Parse(text);
+        double elapsed = seconds_since(start);
+        if (keys.size() != lines) {
+            throw std::runtime_error("ndjson lines lost");
+        }
+        std::cout << fmt::format("  threads: {:2}; MB/s: {:.0f}",
+            threads, text.size() / elapsed / 1e6) << std::endl;
+    }
+}
+
+/*!
+ * @brief MB/s of one csv file parsed by 1..32 threads
+ * @details parses $CHFILLER_BENCH_CSV if set, e.g. a multi-GB file,
+ *  otherwise 8M generated hash_ids
+ */
+void csv_bench() {
+    std::string text;
+    if (const char* path = std::getenv("CHFILLER_BENCH_CSV")) {
+        InputFile file(path);
+        text = readAll(file);
+    } else {
+        std::mt19937_64 rng{42};
+        for (size_t i = 0; i < 8'000'000; ++i) {
+            text += fmt::format("{:x}_{:x}\n", i % 26 + 10, rng() >> 40);
+        }
+    }
+    std::cout << "csv of " << text.size() << " bytes" << std::endl;
+    column_rules_t non_empty;
+    non_empty.min_length = 1;
+    for (unsigned threads: {1u, 2u, 4u, 8u, 16u, 32u}) {
+        CsvReader reader(threads, std::nullopt, {{"hash_id", "String"}},
+                         makeValidators({{"hash_id", non_empty}}));
+        auto start = bench_clock_t::now();
+        size_t lines = reader.Parse(text).size();
+        double elapsed = seconds_since(start);
+        std::cout << fmt::format("  threads: {:2}; lines: {}; MB/s: {:.0f}",
+            threads, lines, text.size() / elapsed / 1e6) << std::endl;
+    }
+}
+
+void putString(std::string& to, std::string_view value) {
+    encodeVarint(value.size(), to);
+    to.append(value);
+}
+
+/*!
+ * @brief MB/s of a Native dump decoded, next to a plain memcpy of it
+ * @details blocks of 64K rows of an UInt64 id, a String key and
+ *  Float64 and UInt32 columns
+ */
+void native_bench() {
+    constexpr size_t blocks{64}, block_rows{64 * 1024};
+    std::string data;
+    for (size_t block = 0; block < blocks; ++block) {
+        encodeVarint(4, data);
+        encodeVarint(block_rows, data);
+        putString(data, "id");
+        putString(data, "UInt64");
+        for (uint64_t i = 0; i < block_rows; ++i) {
+            uint64_t id = block * block_rows + i;
+            data.append(reinterpret_cast<const char*>(&id), sizeof(id));
+        }
+        putString(data, "hash_id");
+        putString(data, "String");
+        for (size_t i = 0; i < block_rows; ++i) {
+            putString(data, fmt::format("d_{:08}", block * block_rows + i));
+        }
+        for (auto [name, type, size]: {std::tuple{"rating", "Float64", 8},
+                                       std::tuple{"trips", "UInt32", 4}}) {
+            putString(data, name);
+            putString(data, type);
+            data.append(block_rows * size, '\1');
+        }
+    }
+    std::cout << "native of " << data.size() << " bytes" << std::endl;
+    NativeReader reader({{"hash_id", "String"}, {"rating", "Float64"},
+                         {"trips", "UInt32"}});
+    auto start = bench_clock_t::now();
+    size_t rows = reader.Parse(data).size();
+    double elapsed = seconds_since(start);
+    if (rows != blocks * block_rows) {
+        throw std::runtime_error("native rows lost");
+    }
+    std::string copy(data.size(), '\0');
+    auto copy_start = bench_clock_t::now();
+    std::memcpy(copy.data(), data.data(), data.size());
+    double copy_elapsed = seconds_since(copy_start);
+    std::cout << fmt::format("  rows: {}; MB/s: {:.0f}; memcpy MB/s: {:.0f}",
+        rows, data.size() / elapsed / 1e6,
+        data.size() / copy_elapsed / 1e6) << std::endl;
+}
+
+///> bytes malloc handed out and didn't get back, mmapped ones too
+size_t heap_bytes() {
+    struct mallinfo2 info = ::mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+///> a key as it is
+struct as_string_t {
+    const std::string& operator()(const std::string& key) const {
+        return key;
+    }
+};
+
+/*!
+ * @brief inserts keys into a Set and prints its speed, the heap it
+ *  takes per key and how long freeing it lasts
+ * @param parse makes a key of the Set from a string one, timed too
+ */
+template <typename Set, typename Parse = as_string_t>
+void dedup_set_run(const char* name, const std::vector<std::string>& keys,
+                   Parse parse = {}) {
+    size_t heap = heap_bytes();
+    auto set = std::make_unique<Set>();
+    auto start = bench_clock_t::now();
+    for (const auto& key: keys) {
+        set->insert(parse(key));
+    }
+    double insert = seconds_since(start);
+    size_t bytes = heap_bytes() - heap;
+    size_t size = set->size();
+    auto teardown_start = bench_clock_t::now();
+    set.reset();
+    std::cout << fmt::format("  {}: values: {}; inserts/s: {:.3e}; "
+        "bytes/value: {:.1f}; teardown ms: {:.1f}", name, size,
+        keys.size() / insert, static_cast<double>(bytes) / size,
+        seconds_since(teardown_start) * 1e3) << std::endl;
+}
+
+/*!
+ * @brief the table's hash_ids as Add keeps them to deduplicate: in a
+ *  std::unordered_set of strings, as before, and in a KeySet
+ */
+void dedup_set_bench() {
+    constexpr size_t values{4'000'000};
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    std::mt19937_64 rng{42};
+    std::vector<std::string> keys(values);
+    for (auto& key: keys) {
+        key.push_back(alphabet[rng() % 26]);
+        key.push_back('_');
+        for (int c = 0; c < 8; ++c) {
+            key.push_back(alphabet[rng() % (sizeof(alphabet) - 1)]);
+        }
+    }
+    std::cout << "dedup set of " << values << " hash_ids" << std::endl;
+    dedup_set_run<std::unordered_set<std::string>>("unordered_set", keys);
+    dedup_set_run<KeySet>("KeySet", keys);
+}
+
+/*!
+ * @brief a UInt64 key column deduplicated by string, as String ones
+ *  are, and by number parsed with from_chars
+ */
+void integer_keys_bench() {
+    constexpr size_t values{4'000'000};
+    std::mt19937_64 rng{42};
+    std::vector<std::string> keys(values);
+    for (auto& key: keys) {
+        key = std::to_string(rng() % 1'000'000'000'000ull);
+    }
+    std::cout << "dedup set of " << values << " UInt64 keys" << std::endl;
+    dedup_set_run<KeySet>("KeySet", keys);
+    dedup_set_run<FlatSet<uint64_t>>("FlatSet<uint64_t>", keys,
+        [] (const std::string& key) {
+            uint64_t number{0};
+            std::from_chars(key.data(), key.data() + key.size(), number);
+            return number;
+        });
+}
+
+const std::map<std::string, std::function<void()>> g_benches{
+    {"snowflake_ids", snowflake_ids_bench},
+    {"compression", compression_bench},
+    {"csv", csv_bench},
+    {"ndjson", ndjson_bench},
+    {"native", native_bench},
+    {"dedup_set", dedup_set_bench},
+    {"integer_keys", integer_keys_bench},
+};
+}
+
+/*!
+ * @brief runs the benches named in argv or all of them
+ */
+int main(int argc, char** argv) {
+    if (argc == 1) {
+        for (const auto& [name, bench]: g_benches) {
+            bench();
+        }
+        return 0;
+    }
+    for (int i = 1; i < argc; ++i) {
+        auto bench = g_benches.find(argv[i]);
+        if (bench == g_benches.end()) {
+            std::cerr << "unknown bench " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+        bench->second();
+    }
+    return 0;
+}
@@ -1,8 +1,12 @@
 #include "chfiller_tests.hpp"
 
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <thread>
 
 #include "ClickhouseFiller.hpp"
+#include "FileManifest.hpp"
 
 namespace {
 const std::string g_clickhuse_host{"192.168.1.21"};
@@ -11,6 +15,18 @@ std::string_view g_table_name{"drivers"};
 ClickhouseFiller::scheme_t g_table_scheme{
     {"id", "UInt64"}, {"hash_id", "String"}
 };
+
+struct driver_t {
+    uint64_t id;
+    std::string hash_id;
+    std::string name;
+    uint8_t rating;
+    static constexpr auto columns = std::make_tuple(
+        field(&driver_t::id, "id"),
+        field(&driver_t::hash_id, "hash_id"),
+        field(&driver_t::name, "name"),
+        field(&driver_t::rating, "rating"));
+};
 }
 
 void filler_ctor_test() {
@@ -81,6 +97,150 @@ void filler_read_json_test() {
     filler.Add("data.json");
 }
 
+void filler_read_ndjson_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable(g_table_name, g_table_scheme);
+    filler.SetKeyPath("driver.hash_id");
+    filler.Add("data.ndjson");
+}
+
+void filler_sniff_format_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable(g_table_name, g_table_scheme);
+    filler.SetKeyPath("driver.hash_id");
+    filler.Add("drivers.log");
+    filler.Add("data.json.gz");
+}
+
+void filler_read_binary_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable(g_table_name, g_table_scheme);
+    filler.Add("data.native");
+    filler.SetFormat(ClickhouseFiller::format_t::row_binary);
+    filler.Add("data.rowbinary");
+}
+
+void filler_native_export_test() {
+    {
+        ClickhouseFiller exporter(
+            std::make_shared<NativeFileSink>("drivers.native.zst",
+                                             compression_t::zstd),
+            g_db_name);
+        exporter.CreateTable(g_table_name, g_table_scheme);
+        exporter.Add("data.csv");
+    }
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable(g_table_name, g_table_scheme);
+    filler.Add("drivers.native.zst");
+}
+
+void filler_read_columns_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable("drivers_columns", {
+        {"id", "UInt64"}, {"hash_id", "String"},
+        {"name", "String"}, {"rating", "UInt8"}
+    });
+    csv_options_t options;
+    options.header = true;
+    filler.SetCsvOptions(options);
+    filler.Add("columns.csv");
+}
+
+void filler_validation_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable("drivers_validated", {
+        {"id", "UInt64"}, {"hash_id", "String"},
+        {"name", "String"}, {"rating", "UInt8"}
+    });
+    csv_options_t options;
+    options.header = true;
+    filler.SetCsvOptions(options);
+    filler.SetValidation(loadRules("rules.json"));
+    filler.SetRejectFile("rejects.tsv");
+    auto [pushed, duplicated] = filler.Add("rejects.csv");
+    std::cout << "rejects.csv: pushed: " << pushed
+              << "; rejected: " << filler.GetReport().rejected << std::endl;
+}
+
+void filler_struct_table_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable<driver_t>("drivers_struct");
+    auto [pushed, duplicated] = filler.AddRecords(std::vector<driver_t>{
+        {0, "q_1", "John Smith", 5}, {0, "q_2", "Ann Lee", 4},
+        {0, "q_1", "John Smith", 5}
+    });
+    std::cout << "drivers_struct: pushed: " << pushed
+              << "; duplicated: " << duplicated << std::endl;
+}
+
+void filler_integer_keys_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable("drivers_integer_keys", {
+        {"id", "UInt64"}, {"hash_id", "UInt64"}
+    });
+    filler.SetRejectFile("int_keys_rejects.tsv");
+    auto [pushed, duplicated] = filler.Add("int_keys.csv");
+    std::cout << "int_keys.csv: pushed: " << pushed
+              << "; duplicated: " << duplicated
+              << "; rejected: " << filler.GetReport().rejected << std::endl;
+}
+
+void filler_composite_keys_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable("drivers_composite", {
+        {"id", "UInt64"}, {"hash_id", "String"},
+        {"region", "String"}, {"date", "Date"}
+    });
+    csv_options_t options;
+    options.header = true;
+    filler.SetCsvOptions(options);
+    filler.SetKeyColumns({"hash_id", "region", "date"});
+    auto [pushed, duplicated] = filler.Add("composite.csv");
+    std::cout << "composite.csv: pushed: " << pushed
+              << "; duplicated: " << duplicated << std::endl;
+}
+
+void filler_dedup_scope_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.SetEngine({"intDiv(id, 4)", ""});
+    filler.CreateTable("drivers_partitioned", g_table_scheme);
+    filler.Add("data.csv");
+    filler.SetDedupScope({"id > 2", {"1"}});
+    auto [pushed, duplicated] = filler.Add("data.csv");
+    std::cout << "drivers_partitioned: pushed: " << pushed
+              << "; duplicated: " << duplicated << std::endl;
+}
+
 void filler_read_misc_test() {
     auto client = clickhouse::Client(
         clickhouse::ClientOptions().SetHost(g_clickhuse_host)
@@ -107,3 +267,129 @@ void filler_ctor_read_misc_test() {
     filler.Add("extra.csv");
     filler.Add("dupl.csv");
 }
+
+void filler_buffered_read_misc_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable(g_table_name, g_table_scheme);
+    filler.SetInsertBuffer({1000, 1 << 20, std::chrono::seconds(10)});
+    filler.Add("data.csv");
+    filler.Add("data.json");
+    filler.Add("extra.csv");
+    filler.Add("dupl.csv");
+}
+
+void filler_read_compressed_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable(g_table_name, g_table_scheme);
+    filler.Add("data.json.gz");
+    filler.Add("extra.csv.zst");
+}
+
+void filler_read_stream_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable(g_table_name, g_table_scheme);
+    filler.SetFormat(ClickhouseFiller::format_t::csv);
+    std::istringstream stream("s_1\ns_2\ns_3\ns_1\n");
+    filler.AddStream(stream, 2);
+}
+
+void filler_follow_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable(g_table_name, g_table_scheme);
+    std::ofstream("follow.csv") << "f_1\nf_2\n";
+    FileFollower follower("follow.csv", "follow.csv.offset");
+    std::atomic<bool> stopped{false};
+    std::thread writer([&stopped] {
+        std::ofstream("follow.csv", std::ios::app) << "f_3\nf_1\n";
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+        stopped = true;
+    });
+    filler.Follow(follower, 100, stopped);
+    writer.join();
+}
+
+void filler_resume_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable(g_table_name, g_table_scheme);
+    filler.SetBlockLimits({2, 1 << 20, false, std::chrono::seconds(1)});
+    filler.AddResumable("extra.csv", "extra.csv.checkpoint", false);
+    filler.AddResumable("extra.csv", "extra.csv.checkpoint", true);
+}
+
+void filler_read_files_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable(g_table_name, g_table_scheme);
+    for (const auto& result:
+            filler.Add({"data.csv", "data.json", "extra.csv", "dupl.csv"}, 4)) {
+        std::cout << result.file << ": " << result.pushed << " "
+                  << result.duplicated << std::endl;
+    }
+}
+
+void filler_manifest_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller filler(client, g_db_name);
+    filler.CreateTable(g_table_name, g_table_scheme);
+    LocalFileManifest manifest("drivers.manifest");
+    for (const std::string file: {"data.csv", "extra.csv"}) {
+        if (manifest.Ingested(file)) {
+            std::cout << file << ": skipped" << std::endl;
+            continue;
+        }
+        filler.Add(file);
+        manifest.Record({file});
+    }
+}
+
+namespace {
+void fill_concurrently(std::shared_ptr<IdGenerator> first_ids,
+                       std::shared_ptr<IdGenerator> second_ids) {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    ClickhouseFiller first(client, g_db_name);
+    first.CreateTable(g_table_name, g_table_scheme);
+    first.SetIdGenerator(first_ids);
+    ClickhouseFiller second(client, g_db_name);
+    second.CreateTable(g_table_name, g_table_scheme);
+    second.SetIdGenerator(second_ids);
+    first.Add("data.csv");
+    second.Add("extra.csv");
+    first.Add("dupl.csv");
+}
+}
+
+void filler_file_leased_ids_test() {
+    fill_concurrently(std::make_shared<FileIdAllocator>("ids.lease", 4),
+                      std::make_shared<FileIdAllocator>("ids.lease", 4));
+}
+
+void filler_ch_leased_ids_test() {
+    auto client = clickhouse::Client(
+        clickhouse::ClientOptions().SetHost(g_clickhuse_host)
+    );
+    fill_concurrently(std::make_shared<ClickhouseIdAllocator>(
+                          client, g_db_name, g_table_name, 4),
+                      std::make_shared<ClickhouseIdAllocator>(
+                          client, g_db_name, g_table_name, 4));
+}
@@ -7,5 +7,24 @@ void filler_drop_table_test();
 void filler_read_test();
 void filler_reread_test();
 void filler_read_json_test();
+void filler_read_ndjson_test();
+void filler_sniff_format_test();
+void filler_read_binary_test();
+void filler_native_export_test();
+void filler_read_columns_test();
+void filler_validation_test();
+void filler_integer_keys_test();
+void filler_struct_table_test();
+void filler_composite_keys_test();
+void filler_dedup_scope_test();
 void filler_read_misc_test();
 void filler_ctor_read_misc_test();
+void filler_buffered_read_misc_test();
+void filler_read_compressed_test();
+void filler_read_stream_test();
+void filler_follow_test();
+void filler_resume_test();
+void filler_read_files_test();
+void filler_manifest_test();
+void filler_file_leased_ids_test();
+void filler_ch_leased_ids_test();
@@ -1,16 +1,435 @@
 #include "uploadDriversData.hpp"
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <glob.h>
+#include <sys/stat.h>
 #include <gflags/gflags.h>
 
 #include "ClickhouseFiller.hpp"
+#include "FileManifest.hpp"
+#include "InputFile.hpp"
+#include "SnowflakeIdGenerator.hpp"
 
 namespace {
 DEFINE_bool(rewrite, false, "if supplied drop the current table");
-DEFINE_string(drivers, "", "path to a file containing drivers\' data");
+DEFINE_string(drivers, "",
+              "comma separated files, directories or globs "
+              "containing drivers\' data");
+DEFINE_string(format, "auto",
+              "input format: auto (sniffed from the content), csv, json, "
+              "ndjson, native, rowbinary (the table's columns but id, in "
+              "order); required for --drivers -, FIFOs and rowbinary");
+DEFINE_string(key_path, "hash_id",
+              "dot separated path of the key in ndjson records");
+DEFINE_bool(csv_columns, false,
+            "parse csv as RFC 4180 records whose fields are mapped onto "
+            "the table columns instead of a key per line");
+DEFINE_string(csv_delimiter, ",",
+              "field delimiter of --csv_columns, \\t or tab for TSV");
+DEFINE_string(csv_quote, "\"", "quote character of --csv_columns");
+DEFINE_string(csv_escape, "\"",
+              "escape character inside quotes of --csv_columns, "
+              "the quote itself means doubled quotes");
+DEFINE_bool(csv_header, false,
+            "the first --csv_columns record names the columns, otherwise "
+            "fields are the key and the other columns in scheme order");
+DEFINE_string(validation_file, "",
+              "json file of per column rules: min_length, max_length, "
+              "charset, utf8, regex, uint64");
+DEFINE_string(reject_file, "",
+              "if supplied records failing validation are appended to it "
+              "instead of failing the load");
+DEFINE_uint32(parse_threads, std::thread::hardware_concurrency(),
+              "number of threads parsing parts of one csv or ndjson file");
+DEFINE_uint64(stream_rows, 100000,
+              "max rows per insert when reading stdin, a FIFO "
+              "or a --follow file");
+DEFINE_bool(follow, false,
+            "keep inserting lines appended to the --drivers file "
+            "until SIGINT/SIGTERM");
+DEFINE_string(follow_offset_file, "",
+              "where --follow keeps its offset, <drivers>.offset by default");
+DEFINE_bool(checkpoint, false,
+            "save progress of every --drivers file to <file>.checkpoint "
+            "after each inserted block");
+DEFINE_bool(resume, false,
+            "go on from the --checkpoint of every --drivers file");
+DEFINE_string(manifest, "none",
+              "skip files loaded before: none, file (--manifest_file), "
+              "clickhouse (the ingested_files table)");
+DEFINE_string(manifest_file, "",
+              "manifest of --manifest=file, <db>.<table>.manifest by default");
+DEFINE_uint32(threads, std::thread::hardware_concurrency(),
+              "number of files parsed at once");
+DEFINE_string(compression, "lz4",
+              "wire compression of inserts and selects: none, lz4, zstd");
+DEFINE_string(output_file, "",
+              "if supplied blocks are written to this Native file instead "
+              "of the server, gzip or zstd compressed for .gz or .zst; "
+              "no server is used and the table is taken as empty");
+DEFINE_bool(dry_run, false,
+            "blocks are serialized and compressed by --compression as for "
+            "the server, then dropped; no server is used, implies --report");
+DEFINE_string(id_allocator, "max",
+              "ids source: max (table max id + 1), "
+              "file (lease from --id_lease_file), "
+              "clickhouse (lease from the id_leases table), "
+              "snowflake (time ordered, not dense)");
+DEFINE_string(id_lease_file, "", "counter file used by --id_allocator=file");
+DEFINE_uint64(id_lease_size, 100000, "number of ids taken per lease");
+DEFINE_uint64(block_rows, 1 << 20, "max rows per inserted block");
+DEFINE_uint64(block_bytes, 256 << 20, "max bytes per inserted block");
+DEFINE_bool(adaptive_blocks, false,
+            "tune rows per block by insert latency and server backpressure");
+DEFINE_uint64(block_latency_ms, 1000,
+              "target insert latency of --adaptive_blocks");
+DEFINE_bool(report, false, "print per block insert statistics");
+DEFINE_uint64(snowflake_worker_id, 0,
+              "process id for --id_allocator=snowflake, unique per loader");
+DEFINE_uint32(snowflake_thread_bits, 4,
+              "bits of the snowflake worker field given to threads");
+DEFINE_string(partition_by, "",
+              "if supplied the table is created as a MergeTree partitioned "
+              "by this expression, e.g. intDiv(id, 1000000)");
+DEFINE_string(order_by, "",
+              "sorting key of a --partition_by table, the key by default");
+DEFINE_string(dedup_where, "",
+              "condition on the table's rows new ones are deduplicated "
+              "against, e.g. id > 1000000; all rows by default");
+DEFINE_string(dedup_partitions, "",
+              "comma separated partition ids of a --partition_by table "
+              "new rows are deduplicated against; all by default");
+
+/*!
+ * @brief expands comma separated paths, globs and directories
+ * @return files in the given order; a directory's regular files and
+ *  glob matches are sorted by name
+ * @throw std::runtime_error if a path matches nothing
+ */
+std::vector<std::string> expandPaths(const std::string& paths)
+{
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+    std::istringstream stream(paths);
+    for (std::string path; std::getline(stream, path, ',');) {
+        if (path.empty()) {
+            continue;
+        }
+        if (fs::is_directory(path)) {
+            std::vector<std::string> directory_files;
+            for (const auto& entry: fs::directory_iterator(path)) {
+                if (entry.is_regular_file()) {
+                    directory_files.push_back(entry.path().string());
+                }
+            }
+            std::sort(directory_files.begin(), directory_files.end());
+            files.insert(files.end(), directory_files.begin(),
+                         directory_files.end());
+            continue;
+        }
+        glob_t matches{};
+        int res = ::glob(path.c_str(), 0, nullptr, &matches);
+        if (res == GLOB_NOMATCH) {
+            ::globfree(&matches);
+            throw std::runtime_error("no files match " + path);
+        }
+        for (size_t i = 0; res == 0 && i < matches.gl_pathc; ++i) {
+            files.push_back(matches.gl_pathv[i]);
+        }
+        ::globfree(&matches);
+        if (res != 0) {
+            throw std::runtime_error("can't expand " + path);
+        }
+    }
+    return files;
+}
+
+/*!
+ * @brief single character of a --csv_* flag
+ * @throw std::invalid_argument if it is longer
+ */
+char csvCharacter(const std::string& flag, const std::string& value)
+{
+    if (value == "tab" || value == "\\t") {
+        return '\t';
+    }
+    if (value.size() != 1) {
+        throw std::invalid_argument(flag + " must be one character");
+    }
+    return value[0];
+}
+
+/*!
+ * @brief csv dialect of the --csv_* flags if --csv_columns is set
+ */
+std::optional<csv_options_t> csvOptions()
+{
+    if (!FLAGS_csv_columns) {
+        return std::nullopt;
+    }
+    csv_options_t options;
+    options.delimiter = csvCharacter("--csv_delimiter", FLAGS_csv_delimiter);
+    options.quote = csvCharacter("--csv_quote", FLAGS_csv_quote);
+    options.escape = csvCharacter("--csv_escape", FLAGS_csv_escape);
+    options.header = FLAGS_csv_header;
+    return options;
+}
+
+/*!
+ * @brief rows deduplicated against of --dedup_where and
+ *  --dedup_partitions
+ */
+ClickhouseFiller::dedup_scope_t dedupScope()
+{
+    ClickhouseFiller::dedup_scope_t scope;
+    scope.where = FLAGS_dedup_where;
+    std::istringstream stream(FLAGS_dedup_partitions);
+    for (std::string partition; std::getline(stream, partition, ',');) {
+        if (!partition.empty()) {
+            scope.partitions.push_back(partition);
+        }
+    }
+    return scope;
+}
+
+/*!
+ * @brief maps --format onto the filler's format
+ * @throw std::invalid_argument on unknown format
+ */
+ClickhouseFiller::format_t inputFormat()
+{
+    if (FLAGS_format == "auto") {
+        return ClickhouseFiller::format_t::automatic;
+    }
+    if (FLAGS_format == "csv") {
+        return ClickhouseFiller::format_t::csv;
+    }
+    if (FLAGS_format == "json") {
+        return ClickhouseFiller::format_t::json;
+    }
+    if (FLAGS_format == "ndjson") {
+        return ClickhouseFiller::format_t::ndjson;
+    }
+    if (FLAGS_format == "native") {
+        return ClickhouseFiller::format_t::native;
+    }
+    if (FLAGS_format == "rowbinary") {
+        return ClickhouseFiller::format_t::row_binary;
+    }
+    throw std::invalid_argument("unknown format " + FLAGS_format);
+}
+
+std::atomic<bool> g_stopped{false};
+
+void stop(int)
+{
+    g_stopped = true;
+}
+
+/*!
+ * @return true for "-" (stdin) and FIFOs
+ */
+bool isStream(const std::string& path)
+{
+    struct stat info{};
+    return path == "-" ||
+        (::stat(path.c_str(), &info) == 0 && S_ISFIFO(info.st_mode));
+}
+
+/*!
+ * @brief prints per file results and their totals
+ * @param skipped number of files found in the manifest
+ * @return number of files which failed
+ */
+size_t printResults(
+    const std::vector<ClickhouseFiller::file_result_t>& results,
+    size_t skipped)
+{
+    size_t pushed{0}, duplicated{0}, rejected{0}, failed{0};
+    for (const auto& result: results) {
+        if (!result.error.empty()) {
+            std::cerr << result.file << ": " << result.error << std::endl;
+            ++failed;
+            continue;
+        }
+        if (results.size() > 1) {
+            std::cout << result.file << ": pushed: " << result.pushed
+                      << "; duplicated: " << result.duplicated
+                      << "; rejected: " << result.rejected << std::endl;
+        }
+        pushed += result.pushed;
+        duplicated += result.duplicated;
+        rejected += result.rejected;
+    }
+    std::cout << "pushed: " << pushed
+              << "; duplicated: " << duplicated;
+    if (rejected) {
+        std::cout << "; rejected: " << rejected;
+    }
+    if (results.size() > 1 || skipped) {
+        std::cout << "; files: " << results.size() << "; failed: " << failed
+                  << "; skipped: " << skipped;
+    }
+    std::cout << std::endl;
+    return failed;
+}
+
+/*!
+ * @brief maps --compression onto the client's compression method
+ * @throw std::invalid_argument on unknown or unsupported method
+ */
+clickhouse::CompressionMethod compressionMethod()
+{
+    if (FLAGS_compression == "none") {
+        return clickhouse::CompressionMethod::None;
+    }
+    if (FLAGS_compression == "lz4") {
+        return clickhouse::CompressionMethod::LZ4;
+    }
+#ifdef CHFILLER_WITH_ZSTD
+    if (FLAGS_compression == "zstd") {
+        return clickhouse::CompressionMethod::ZSTD;
+    }
+#endif
+    throw std::invalid_argument("unsupported compression " + FLAGS_compression);
+}
+
+/*!
+ * @brief makes the block sink of --output_file or --dry_run
+ * @return nullptr to insert into the server
+ * @throw std::invalid_argument on unsupported compression
+ */
+std::shared_ptr<BlockSink> makeSink()
+{
+    if (FLAGS_dry_run) {
+        using method_t = clickhouse::CompressionMethod;
+        auto method = compressionMethod();
+        return std::make_shared<DryRunSink>(
+            method == method_t::None ? compression_t::none :
+            method == method_t::LZ4 ? compression_t::lz4 :
+                                      compression_t::zstd);
+    }
+    if (FLAGS_output_file.empty()) {
+        return nullptr;
+    }
+    std::string_view extension{FLAGS_output_file};
+    extension.remove_prefix(std::min(extension.size(),
+                                     extension.find_last_of('.') + 1));
+    return std::make_shared<NativeFileSink>(FLAGS_output_file,
+        extension == "gz" ? compression_t::gzip :
+        extension == "zst" ? compression_t::zstd : compression_t::none);
+}
+
+/*!
+ * @brief makes an id generator chosen by --id_allocator
+ * @param client nullptr without a server
+ * @return nullptr for the default max id + 1 ids
+ * @throw std::invalid_argument on unknown allocator or if it needs a
+ *  server
+ */
+std::shared_ptr<IdGenerator> makeIdGenerator(clickhouse::Client* client,
+                                             std::string_view db_name,
+                                             std::string_view table_name)
+{
+    if (FLAGS_id_allocator == "max") {
+        return nullptr;
+    }
+    if (FLAGS_id_allocator == "file") {
+        if (FLAGS_id_lease_file.empty()) {
+            throw std::invalid_argument("--id_lease_file can't be empty");
+        }
+        return std::make_shared<FileIdAllocator>(FLAGS_id_lease_file,
+                                                 FLAGS_id_lease_size);
+    }
+    if (FLAGS_id_allocator == "clickhouse") {
+        if (!client) {
+            throw std::invalid_argument(
+                "--id_allocator=clickhouse needs a server");
+        }
+        return std::make_shared<ClickhouseIdAllocator>(
+            *client, db_name, table_name, FLAGS_id_lease_size);
+    }
+    if (FLAGS_id_allocator == "snowflake") {
+        return std::make_shared<SnowflakeIdGenerator>(
+            FLAGS_snowflake_worker_id, FLAGS_snowflake_thread_bits);
+    }
+    throw std::invalid_argument("unknown id allocator " + FLAGS_id_allocator);
+}
+
+/*!
+ * @brief makes a manifest chosen by --manifest
+ * @param client nullptr without a server
+ * @return nullptr if none
+ * @throw std::invalid_argument on unknown manifest or if it needs a
+ *  server
+ */
+std::unique_ptr<FileManifest> makeManifest(clickhouse::Client* client,
+                                           std::string_view db_name,
+                                           std::string_view table_name)
+{
+    if (FLAGS_manifest == "none") {
+        return nullptr;
+    }
+    if (FLAGS_manifest == "file") {
+        return std::make_unique<LocalFileManifest>(
+            FLAGS_manifest_file.empty() ?
+                std::string{db_name} + "." + std::string{table_name} +
+                    ".manifest" :
+                FLAGS_manifest_file);
+    }
+    if (FLAGS_manifest == "clickhouse") {
+        if (!client) {
+            throw std::invalid_argument(
+                "--manifest=clickhouse needs a server");
+        }
+        return std::make_unique<ClickhouseManifest>(*client, db_name,
+                                                    table_name);
+    }
+    throw std::invalid_argument("unknown manifest " + FLAGS_manifest);
+}
+
+/*!
+ * @brief prints per block timings and their summary
+ */
+void printReport(const ClickhouseFiller::report_t& report)
+{
+    std::chrono::microseconds total{0}, slowest{0};
+    size_t rows{0}, bytes{0};
+    for (size_t i = 0; i < report.blocks.size(); ++i) {
+        const auto& block = report.blocks[i];
+        std::cout << "block " << i << ": rows: " << block.rows
+                  << "; bytes: " << block.bytes
+                  << "; ms: " << block.elapsed.count() / 1000.0
+                  << "; retries: " << block.retries << std::endl;
+        total += block.elapsed;
+        slowest = std::max(slowest, block.elapsed);
+        rows += block.rows;
+        bytes += block.bytes;
+    }
+    std::cout << "blocks: " << report.blocks.size() << "; rows: " << rows
+              << "; bytes: " << bytes
+              << "; insert ms: " << total.count() / 1000.0
+              << "; slowest block ms: " << slowest.count() / 1000.0
+              << "; rejected: " << report.rejected << std::endl;
+    const auto& memory = report.memory;
+    std::cout << "values: " << memory.values
+              << "; set bytes: " << memory.bytes
+              << "; teardown ms: " << memory.teardown.count() / 1000.0
+              << "; peak rss MB: " << memory.peak_rss / (1 << 20)
+              << "; reserve hits: " << report.reserves.hits << "/"
+              << report.reserves.reserves << std::endl;
+}
 }
 /*!
  * @brief uploads data from --drivers file to CH table
- * @param client Clickhouse client
+ * @param options Clickhouse client options, --compression is applied
  * @param db_name name of data base to be used
  * @param table_name table to be created and filled
  * @param scheme a vector of string pairs. example:
@@ -18,9 +437,19 @@ DEFINE_string(drivers, "", "path to a file containing drivers\' data");
  * @param argc passed from main()'s argc
  * @param argv passed from main()'s argv
  * @return 0 if successfull or error code otherwise
- * @details if argv has --rewrite drops current table
+ * @details if argv has --rewrite drops current table;
+ *  --drivers files are deduplicated against one snapshot of the table;
+ *  --drivers - (stdin) or a FIFO is inserted in chunks as it arrives;
+ *  --follow keeps inserting lines appended to the --drivers file;
+ *  --checkpoint/--resume make loads of big files resumable;
+ *  --manifest skips files loaded by earlier runs;
+ *  --id_allocator=file|clickhouse lets several loaders fill a table at once;
+ *  --output_file and --dry_run make blocks without a server, so they
+ *  refuse --manifest, --checkpoint and --follow which would record the
+ *  files or their offsets as loaded;
+ *  --partition_by and --dedup_* limit the snapshot to recent partitions
  */
-[[nodiscard]] int uploadDriversData(clickhouse::Client& client,
+[[nodiscard]] int uploadDriversData(clickhouse::ClientOptions options,
     std::string_view db_name,
     std::string_view table_name,
     const ClickhouseFiller::scheme_t& scheme,
@@ -32,14 +461,101 @@ DEFINE_string(drivers, "", "path to a file containing drivers\' data");
         return EINVAL;
     }
     try {
-        ClickhouseFiller filler(client, db_name);
+        auto sink = makeSink();
+        if (sink && (FLAGS_manifest != "none" || FLAGS_checkpoint ||
+                     FLAGS_resume || FLAGS_follow)) {
+            throw std::invalid_argument("--manifest, --checkpoint, --resume "
+                "and --follow record loads into the table, they can't go "
+                "with --output_file or --dry_run");
+        }
+        std::unique_ptr<clickhouse::Client> client;
+        if (!sink) {
+            client = std::make_unique<clickhouse::Client>(
+                options.SetCompressionMethod(compressionMethod()));
+        }
+        ClickhouseFiller filler = client ?
+            ClickhouseFiller(*client, db_name) :
+            ClickhouseFiller(sink, db_name);
         if (FLAGS_rewrite) {
             filler.DropTable();
         }
+        filler.SetEngine({FLAGS_partition_by, FLAGS_order_by});
         filler.CreateTable(table_name, scheme);
-        auto [pushed, duplicated] = filler.Add(FLAGS_drivers);
-        std::cout << "pushed: " << pushed
-                  << "; duplicated: " << duplicated << std::endl;
+        filler.SetDedupScope(dedupScope());
+        filler.SetIdGenerator(
+            makeIdGenerator(client.get(), db_name, table_name));
+        filler.SetBlockLimits({FLAGS_block_rows, FLAGS_block_bytes,
+            FLAGS_adaptive_blocks,
+            std::chrono::milliseconds(FLAGS_block_latency_ms)});
+        filler.SetFormat(inputFormat());
+        filler.SetKeyPath(FLAGS_key_path);
+        filler.SetParseThreads(FLAGS_parse_threads);
+        filler.SetCsvOptions(csvOptions());
+        if (!FLAGS_validation_file.empty()) {
+            filler.SetValidation(loadRules(FLAGS_validation_file));
+        }
+        if (!FLAGS_reject_file.empty()) {
+            filler.SetRejectFile(FLAGS_reject_file);
+        }
+        std::vector<ClickhouseFiller::file_result_t> results;
+        size_t skipped{0};
+        if (FLAGS_follow) {
+            FileFollower follower(FLAGS_drivers,
+                FLAGS_follow_offset_file.empty() ?
+                    FLAGS_drivers + ".offset" : FLAGS_follow_offset_file);
+            std::signal(SIGINT, stop);
+            std::signal(SIGTERM, stop);
+            auto [pushed, duplicated] =
+                filler.Follow(follower, FLAGS_stream_rows, g_stopped);
+            results.push_back({FLAGS_drivers, pushed, duplicated, {},
+                               filler.GetReport().rejected});
+        } else if (isStream(FLAGS_drivers)) {
+            InputFile input(FLAGS_drivers);
+            auto [pushed, duplicated] =
+                filler.AddStream(input, FLAGS_stream_rows);
+            results.push_back({FLAGS_drivers, pushed, duplicated, {},
+                               filler.GetReport().rejected});
+        } else {
+            std::vector<std::string> files = expandPaths(FLAGS_drivers);
+            auto manifest = makeManifest(client.get(), db_name, table_name);
+            if (manifest) {
+                auto ingested = std::remove_if(files.begin(), files.end(),
+                    [&] (const std::string& file) {
+                        return manifest->Ingested(file);
+                    });
+                skipped = files.end() - ingested;
+                files.erase(ingested, files.end());
+            }
+            if (FLAGS_checkpoint || FLAGS_resume) {
+                for (const auto& file: files) {
+                    size_t rejected = filler.GetReport().rejected;
+                    auto [pushed, duplicated] = filler.AddResumable(
+                        file, file + ".checkpoint", FLAGS_resume);
+                    results.push_back({file, pushed, duplicated, {},
+                        filler.GetReport().rejected - rejected});
+                }
+            } else {
+                results = filler.Add(files, FLAGS_threads);
+            }
+            filler.Flush();
+            if (manifest) {
+                std::vector<std::string> loaded;
+                for (const auto& result: results) {
+                    if (result.error.empty()) {
+                        loaded.push_back(result.file);
+                    }
+                }
+                manifest->Record(loaded);
+            }
+        }
+        filler.Flush();
+        size_t failed = printResults(results, skipped);
+        if (FLAGS_report || FLAGS_dry_run) {
+            printReport(filler.GetReport());
+        }
+        if (failed) {
+            return EXIT_FAILURE;
+        }
 
     }  catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
@@ -1,7 +1,7 @@
 #pragma once
 #include "ClickhouseFiller.hpp"
 
-[[nodiscard]] int uploadDriversData(clickhouse::Client& client,
+[[nodiscard]] int uploadDriversData(clickhouse::ClientOptions options,
     std::string_view db_name,
     std::string_view table_name,
     const ClickhouseFiller::scheme_t& scheme,